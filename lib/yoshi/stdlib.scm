@@ -192,20 +192,15 @@
   (iter 0))
 
 (define (list->vector list)
-  (define length (length list))
-  (define vector (make-vector length))
+  (define len (length list))
+  (define vec (make-vector len))
   (define (iter k list)
     (if (null? list)
-        vector
+        vec
         (begin
-          (vector-set! vector k (car list))
+          (vector-set! vec k (car list))
           (iter (+ k 1) (cdr list)))))
   (iter 0 list))
 
 (define (vector . objs)
   (list->vector objs))
-
-(define (call-with-current-continuation proc)
-  "Maybe later.")
-
-(define call/cc call-with-current-continuation)
@@ -0,0 +1,428 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "analyze.h"
+#include "env.h"
+#include "err.h"
+#include "exp.h"
+#include "symtab.h"
+
+/* analysis runs once per form, after expansion, and turns the */
+/* s-expression into a tree of NODE records so that eval never */
+/* has to classify syntax again. it assumes expanded input. */
+
+/* the scope has one entry per enclosing lambda, innermost first, */
+/* kept on the c stack. frame is the list of symbols bound by the */
+/* lambda: its parameters plus any internal defines found in its */
+/* body. closures are flat: a variable of an enclosing lambda that */
+/* is used inside this one is added to free, and captures holds */
+/* the nodes that load it in the enclosing scope when the closure */
+/* is made. so a closure keeps only the values it needs alive. */
+
+/* copying a variable into a closure is only safe if it is never */
+/* assigned, so a local that is captured and assigned lives in a */
+/* box instead, which the frame and the closures share. boxed */
+/* lists those variables, both locals and free ones. */
+
+/* nodes for globals keep the variable's cell in their third slot. */
+struct scope {
+  struct exp *frame;
+  struct exp *free;
+  struct exp *captures;
+  struct exp *boxed;
+  struct scope *parent;
+};
+
+enum place {
+  PLACE_GLOBAL,
+  PLACE_LOCAL,
+  PLACE_FREE
+};
+
+static struct exp *analyze_in(struct exp *exp, struct scope *scope);
+static struct exp *analyze_quote(struct exp *exp, struct scope *scope);
+static struct exp *analyze_set(struct exp *exp, struct scope *scope);
+static struct exp *analyze_define(struct exp *exp, struct scope *scope);
+static struct exp *analyze_if(struct exp *exp, struct scope *scope);
+static struct exp *analyze_or(struct exp *exp, struct scope *scope);
+static struct exp *analyze_lambda(struct exp *exp, struct scope *scope);
+static struct exp *analyze_begin(struct exp *exp, struct scope *scope);
+static struct exp *analyze_apply(struct exp *exp, struct scope *scope);
+static struct exp *map_analyze(struct exp *exp, void *data);
+static struct exp *map_source(struct exp *exp, void *data);
+
+struct tag_analyze {
+  enum keyword tag;
+  struct exp *(*analyze)(struct exp *exp, struct scope *scope);
+};
+
+static struct tag_analyze tag_map[] = {
+  { .tag = KEYWORD_QUOTE, .analyze = &analyze_quote },
+  { .tag = KEYWORD_SET, .analyze = &analyze_set },
+  { .tag = KEYWORD_DEFINE, .analyze = &analyze_define },
+  { .tag = KEYWORD_IF, .analyze = &analyze_if },
+  { .tag = KEYWORD_OR, .analyze = &analyze_or },
+  { .tag = KEYWORD_LAMBDA, .analyze = &analyze_lambda },
+  { .tag = KEYWORD_BEGIN, .analyze = &analyze_begin }
+};
+
+#define NELEM(arr) ((sizeof arr) / (sizeof arr[0]))
+
+/* the standard requires numbers, strings, characters, */
+/* booleans, and bytevectors to be self-evaluating. */
+/* i do not believe it forbids undefined or procedures */
+/* from also being self-evaluating. */
+/* lists, vectors, and nil are explicitly not self-evaluating. */
+int analyze_self_eval(struct exp *exp) {
+  return (IS(exp, UNDEFINED) ||
+          IS(exp, FIXNUM) ||
+          IS(exp, STRING) ||
+          IS(exp, CHARACTER) ||
+          IS(exp, BOOLEAN) ||
+          IS(exp, BYTEVECTOR) ||
+          IS(exp, FUNCTION) ||
+          IS(exp, CLOSURE));
+}
+
+/* finds the position of a symbol in a frame, or -1 */
+static long frame_index(struct exp *frame, struct exp *symbol) {
+  long i;
+  for (i = 0; frame != NIL; frame = CDR(frame), i += 1) {
+    if (symbol == CAR(frame)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static struct exp *append(struct exp *list, struct exp *item) {
+  if (list == NIL) {
+    return exp_make_pair(item, NIL);
+  }
+  CDR(list) = append(CDR(list), item);
+  return list;
+}
+
+/* fills in the slot of a variable and whether it is boxed, and */
+/* says where it lives. a variable of an enclosing lambda becomes */
+/* free in every lambda between there and here. */
+static enum place resolve(struct scope *scope, struct exp *symbol,
+                          struct exp *node) {
+  long slot;
+  if (scope == NULL) {
+    return PLACE_GLOBAL;
+  }
+  node->value.node.boxed = frame_index(scope->boxed, symbol) >= 0;
+  if ((slot = frame_index(scope->frame, symbol)) >= 0) {
+    node->value.node.slot = slot;
+    return PLACE_LOCAL;
+  }
+  slot = frame_index(scope->free, symbol);
+  if (slot < 0) {
+    struct exp *capture = exp_make_node(NODE_LOCAL, symbol, NIL, NIL);
+    switch (resolve(scope->parent, symbol, capture)) {
+    case PLACE_GLOBAL:
+      return PLACE_GLOBAL;
+    case PLACE_FREE:
+      capture->value.node.type = NODE_FREE;
+      break;
+    default:
+      break;
+    }
+    /* the closure takes the box itself */
+    if (capture->value.node.boxed) {
+      capture->value.node.boxed = 0;
+      node->value.node.boxed = 1;
+      scope->boxed = exp_make_pair(symbol, scope->boxed);
+    }
+    slot = exp_list_length(scope->free);
+    err_ensure(slot < ANALYZE_SLOTS_MAX, "analyze: too many free variables",
+               symbol);
+    scope->free = append(scope->free, symbol);
+    scope->captures = append(scope->captures, capture);
+  }
+  node->value.node.slot = slot;
+  return PLACE_FREE;
+}
+
+struct exp *analyze(struct exp *exp) {
+  return analyze_in(exp, NULL);
+}
+
+static struct exp *analyze_in(struct exp *exp, struct scope *scope) {
+  assert(exp != NULL);
+  if (analyze_self_eval(exp)) {
+    return exp_make_node(NODE_CONST, exp, NIL, NIL);
+  } else if (IS(exp, SYMBOL)) {
+    struct exp *node = exp_make_node(NODE_LOCAL, exp, NIL, NIL);
+    switch (resolve(scope, exp, node)) {
+    case PLACE_GLOBAL:
+      node->value.node.type = NODE_GLOBAL;
+      node->value.node.c = env_cell(exp);
+      break;
+    case PLACE_FREE:
+      node->value.node.type = NODE_FREE;
+      break;
+    default:
+      break;
+    }
+    return node;
+  } else if (IS(exp, PAIR)) {
+    size_t i;
+    for (i = 0; i < NELEM(tag_map); i += 1) {
+      if (exp_list_tagged(exp, keywords[tag_map[i].tag])) {
+        return (*tag_map[i].analyze)(exp, scope);
+      }
+    }
+    return analyze_apply(exp, scope);
+  } else {
+    return err_error("eval: unknown exp type", exp);
+  }
+}
+
+#undef NELEM
+
+static struct exp *analyze_quote(struct exp *exp, struct scope *scope) {
+  return exp_make_node(NODE_CONST, CADR(exp), NIL, NIL);
+}
+
+static struct exp *analyze_set(struct exp *exp, struct scope *scope) {
+  struct exp *node = exp_make_node(NODE_SET_LOCAL, CADR(exp),
+                                   analyze_in(CADDR(exp), scope), NIL);
+  switch (resolve(scope, CADR(exp), node)) {
+  case PLACE_GLOBAL:
+    node->value.node.type = NODE_SET_GLOBAL;
+    node->value.node.c = env_cell(CADR(exp));
+    break;
+  case PLACE_FREE:
+    node->value.node.type = NODE_SET_FREE;
+    break;
+  default:
+    break;
+  }
+  return node;
+}
+
+/* a define inside a lambda body was already added to its frame */
+/* by scan_defines, so any define seen within a scope is local */
+static struct exp *analyze_define(struct exp *exp, struct scope *scope) {
+  struct exp *node = exp_make_node(NODE_DEFINE_GLOBAL, CADR(exp),
+                                   analyze_in(CADDR(exp), scope), NIL);
+  if (scope != NULL) {
+    node->value.node.type = NODE_DEFINE_LOCAL;
+    node->value.node.slot = frame_index(scope->frame, CADR(exp));
+    node->value.node.boxed = frame_index(scope->boxed, CADR(exp)) >= 0;
+  } else {
+    node->value.node.c = env_cell(CADR(exp));
+  }
+  return node;
+}
+
+static struct exp *analyze_if(struct exp *exp, struct scope *scope) {
+  return exp_make_node(NODE_IF,
+                       analyze_in(CADR(exp), scope),
+                       analyze_in(CADDR(exp), scope),
+                       analyze_in(CADDDR(exp), scope));
+}
+
+static struct exp *analyze_or(struct exp *exp, struct scope *scope) {
+  if (CDR(exp) == NIL) {
+    return exp_make_node(NODE_CONST, FALSE, NIL, NIL);
+  } else {
+    return exp_make_node(NODE_OR,
+                         exp_list_map(CDR(exp), &map_analyze, scope),
+                         NIL, NIL);
+  }
+}
+
+static struct exp *frame_add(struct exp *frame, struct exp *symbol) {
+  if (frame == NIL) {
+    return exp_make_pair(symbol, NIL);
+  } else if (symbol != CAR(frame)) {
+    CDR(frame) = frame_add(CDR(frame), symbol);
+  }
+  return frame;
+}
+
+/* adds the variables defined directly in a lambda body to its */
+/* frame, not counting the bodies of nested lambdas */
+static struct exp *scan_defines(struct exp *exp, struct exp *frame) {
+  if (!IS(exp, PAIR) ||
+      exp_list_tagged(exp, KEYWORD(QUOTE)) ||
+      exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    return frame;
+  } else if (exp_list_tagged(exp, KEYWORD(DEFINE))) {
+    return scan_defines(CADDR(exp), frame_add(frame, CADR(exp)));
+  } else {
+    for (; IS(exp, PAIR); exp = CDR(exp)) {
+      frame = scan_defines(CAR(exp), frame);
+    }
+    return frame;
+  }
+}
+
+/* whether symbol is used inside a lambda nested in exp. like */
+/* analyze_assigned, this ignores shadowing. */
+static int captured_in(struct exp *symbol, struct exp *exp) {
+  if (!IS(exp, PAIR) || exp_list_tagged(exp, KEYWORD(QUOTE))) {
+    return 0;
+  } else if (exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    return analyze_occurs(symbol, CADDR(exp));
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    if (captured_in(symbol, CAR(exp))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int analyze_assigned(struct exp *symbol, struct exp *exp) {
+  if (!IS(exp, PAIR) || exp_list_tagged(exp, KEYWORD(QUOTE))) {
+    return 0;
+  } else if ((exp_list_tagged(exp, KEYWORD(SET)) ||
+              exp_list_tagged(exp, KEYWORD(DEFINE))) &&
+             CADR(exp) == symbol) {
+    return 1;
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    if (analyze_assigned(symbol, CAR(exp))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int analyze_occurs(struct exp *symbol, struct exp *exp) {
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    if (analyze_occurs(symbol, CAR(exp))) {
+      return 1;
+    }
+  }
+  return exp == symbol;
+}
+
+/* parameters take the first slots of a frame, in order, */
+/* followed by the rest parameter and the internal defines. */
+/* the body starts by boxing the variables that need it. */
+static struct exp *analyze_lambda(struct exp *exp, struct scope *scope) {
+  struct exp *params = CADR(exp);
+  struct exp *body = CADDR(exp);
+  struct exp *defines = scan_defines(body, NIL);
+  struct scope inner = { NIL, NIL, NIL, NIL, scope };
+  struct exp *boxes = NIL;
+  struct exp *rest;
+  struct exp *node;
+  size_t size;
+  for (; IS(params, PAIR); params = CDR(params)) {
+    err_ensure(frame_index(inner.frame, CAR(params)) < 0,
+               "analyze: duplicate parameter", CAR(params));
+    inner.frame = frame_add(inner.frame, CAR(params));
+  }
+  if (IS(params, SYMBOL)) {
+    err_ensure(frame_index(inner.frame, params) < 0,
+               "analyze: duplicate parameter", params);
+    inner.frame = frame_add(inner.frame, params);
+  }
+  for (rest = defines; rest != NIL; rest = CDR(rest)) {
+    inner.frame = frame_add(inner.frame, CAR(rest));
+  }
+  size = exp_list_length(inner.frame);
+  err_ensure(size <= ANALYZE_SLOTS_MAX, "analyze: too many locals", exp);
+  for (rest = inner.frame; rest != NIL; rest = CDR(rest)) {
+    struct exp *symbol = CAR(rest);
+    if ((frame_index(defines, symbol) >= 0 ||
+         analyze_assigned(symbol, body)) &&
+        captured_in(symbol, body)) {
+      struct exp *box = exp_make_node(NODE_BOX, symbol, NIL, NIL);
+      box->value.node.slot = frame_index(inner.frame, symbol);
+      inner.boxed = exp_make_pair(symbol, inner.boxed);
+      boxes = exp_make_pair(box, boxes);
+    }
+  }
+  node = analyze_in(body, &inner);
+  if (boxes != NIL) {
+    node = exp_make_node(NODE_BEGIN, append(boxes, node), NIL, NIL);
+  }
+  node = exp_make_node(NODE_LAMBDA, CADR(exp), node, NIL);
+  node->value.node.slot = size;
+  node->value.node.d = inner.captures;
+  return node;
+}
+
+static struct exp *analyze_begin(struct exp *exp, struct scope *scope) {
+  if (CDR(exp) == NIL) {
+    return exp_make_node(NODE_CONST, OK, NIL, NIL);
+  } else {
+    return exp_make_node(NODE_BEGIN,
+                         exp_list_map(CDR(exp), &map_analyze, scope),
+                         NIL, NIL);
+  }
+}
+
+/* an application keeps its argument count in the slot field */
+static struct exp *analyze_apply(struct exp *exp, struct scope *scope) {
+  struct exp *node = exp_make_node(NODE_APPLY,
+                                   analyze_in(CAR(exp), scope),
+                                   exp_list_map(CDR(exp), &map_analyze, scope),
+                                   NIL);
+  size_t argc = exp_list_length(CDR(exp));
+  err_ensure(argc <= ANALYZE_SLOTS_MAX, "analyze: too many arguments", exp);
+  node->value.node.slot = argc;
+  return node;
+}
+
+static struct exp *map_analyze(struct exp *exp, void *data) {
+  struct scope *scope = data;
+  return analyze_in(exp, scope);
+}
+
+/* turns a node back into the s-expression it came from. */
+/* this is only meant for debugging output. */
+struct exp *analyze_source(struct exp *node) {
+  struct exp *a = node->value.node.a;
+  struct exp *b = node->value.node.b;
+  struct exp *c = node->value.node.c;
+  switch (node->value.node.type) {
+  case NODE_CONST:
+    return analyze_self_eval(a) ? a : exp_quote(a);
+  case NODE_LOCAL:
+  case NODE_FREE:
+  case NODE_GLOBAL:
+    return a;
+  case NODE_SET_LOCAL:
+  case NODE_SET_FREE:
+  case NODE_SET_GLOBAL:
+    return exp_make_list(KEYWORD(SET), a, analyze_source(b), NULL);
+  case NODE_DEFINE_LOCAL:
+  case NODE_DEFINE_GLOBAL:
+    return exp_make_list(KEYWORD(DEFINE), a, analyze_source(b),
+                         NULL);
+  case NODE_IF:
+    return exp_make_list(KEYWORD(IF), analyze_source(a),
+                         analyze_source(b), analyze_source(c), NULL);
+  case NODE_OR:
+    return exp_make_pair(KEYWORD(OR),
+                         exp_list_map(a, &map_source, NULL));
+  case NODE_LAMBDA:
+    return exp_make_list(KEYWORD(LAMBDA), a, analyze_source(b),
+                         NULL);
+  case NODE_BEGIN:
+    while (IS(a, PAIR) && CAR(a)->value.node.type == NODE_BOX) {
+      a = CDR(a);
+    }
+    if (CDR(a) == NIL) {
+      return analyze_source(CAR(a));
+    }
+    return exp_make_pair(KEYWORD(BEGIN),
+                         exp_list_map(a, &map_source, NULL));
+  case NODE_APPLY:
+    return exp_make_pair(analyze_source(a), exp_list_map(b, &map_source, NULL));
+  default:
+    return err_error("analyze: bad node type", NULL);
+  }
+}
+
+static struct exp *map_source(struct exp *exp, void *data) {
+  return analyze_source(exp);
+}
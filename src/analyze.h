@@ -0,0 +1,12 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+/* the most slots a frame or closure can have */
+#define ANALYZE_SLOTS_MAX 0xffff
+extern struct exp *analyze(struct exp *exp);
+extern struct exp *analyze_source(struct exp *node);
+extern int analyze_self_eval(struct exp *exp);
+/* syntactic checks on expanded code that ignore shadowing, and */
+/* so can only err on the side of saying yes */
+extern int analyze_assigned(struct exp *symbol, struct exp *exp);
+extern int analyze_occurs(struct exp *symbol, struct exp *exp);
+#endif
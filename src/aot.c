@@ -0,0 +1,657 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "analyze.h"
+#include "config.h"
+#include "env.h"
+#include "err.h"
+#include "exp.h"
+#include "expand.h"
+#include "optimize.h"
+#include "read.h"
+#include "symtab.h"
+#include "util/input.h"
+#include "util/vector.h"
+
+/* the ahead-of-time compiler reads and expands every form of the */
+/* stdlib and the program up front, then writes the analyzed code */
+/* out as c. each top-level form becomes a function tN and each */
+/* lambda a function pN, with the signature in runtime.h. */
+/* constants are built once at startup into k and the cells of */
+/* globals looked up into g, so compiled code just indexes them. */
+
+/* the generated c is written as statements that store the value */
+/* of a node into a named variable, or return it from a node in */
+/* tail position, which is what a NULL destination means. */
+
+static struct {
+  FILE *out;
+  struct vector *constants;
+  struct vector *globals;
+  struct vector *lambdas;
+  int indent;
+  unsigned temps;
+} aot;
+
+static void gen(struct exp *node, const char *dest);
+
+static size_t index_of(struct vector *v, void *item) {
+  size_t i;
+  for (i = 0; i < vector_length(v); i += 1) {
+    if (vector_get(v, i) == item) {
+      return i;
+    }
+  }
+  vector_push(v, item);
+  return i;
+}
+
+/* the parts of a constant are registered before it, so the table */
+/* can be built in order */
+static size_t constant(struct exp *exp) {
+  if (IS(exp, PAIR)) {
+    constant(CAR(exp));
+    constant(CDR(exp));
+  } else if (IS(exp, VECTOR) || IS(exp, BYTEVECTOR)) {
+    struct vector *items = IS(exp, VECTOR) ?
+      exp->value.vector : exp->value.bytevector;
+    size_t i;
+    for (i = 0; i < vector_length(items); i += 1) {
+      constant(vector_get(items, i));
+    }
+  } else if (IS(exp, NODE)) {
+    constant(exp->value.node.a);
+  }
+  return index_of(aot.constants, exp);
+}
+
+static size_t global(struct exp *cell) {
+  return index_of(aot.globals, cell);
+}
+
+static char *vformat(const char *fmt, va_list ap) {
+  va_list copy;
+  int length;
+  char *str;
+  va_copy(copy, ap);
+  length = vsnprintf(NULL, 0, fmt, copy);
+  va_end(copy);
+  str = malloc(length + 1);
+  vsnprintf(str, length + 1, fmt, ap);
+  return str;
+}
+
+static char *format(const char *fmt, ...) {
+  va_list ap;
+  char *str;
+  va_start(ap, fmt);
+  str = vformat(fmt, ap);
+  va_end(ap);
+  return str;
+}
+
+static void line(const char *fmt, ...) {
+  va_list ap;
+  fprintf(aot.out, "%*s", aot.indent * 2, "");
+  va_start(ap, fmt);
+  vfprintf(aot.out, fmt, ap);
+  va_end(ap);
+  fputc('\n', aot.out);
+}
+
+static void open_block(void) {
+  line("{");
+  aot.indent += 1;
+}
+
+static void close_block(void) {
+  aot.indent -= 1;
+  line("}");
+}
+
+static char *temp(void) {
+  char *name = format("t%u", aot.temps);
+  aot.temps += 1;
+  line("struct exp *%s;", name);
+  return name;
+}
+
+static void result(const char *dest, const char *fmt, ...) {
+  va_list ap;
+  char *value;
+  va_start(ap, fmt);
+  value = vformat(fmt, ap);
+  va_end(ap);
+  if (dest == NULL) {
+    line("return %s;", value);
+  } else {
+    line("%s = %s;", dest, value);
+  }
+  free(value);
+}
+
+static char *slot(struct exp *node, int boxed) {
+  const char *slots;
+  switch (node->value.node.type) {
+  case NODE_FREE:
+  case NODE_SET_FREE:
+    slots = "f->slots";
+    break;
+  default:
+    slots = "l";
+    break;
+  }
+  return format(boxed && node->value.node.boxed ?
+                "%s[%u]->value.cell.value" : "%s[%u]",
+                slots, node->value.node.slot);
+}
+
+static void call(const char *fn, size_t argc, const char **args,
+                 const char *dest) {
+  size_t i;
+  char *argv = format("t%u", aot.temps);
+  aot.temps += 1;
+  line("struct exp **%s = runtime_push(%lu);", argv, (unsigned long)argc);
+  for (i = 0; i < argc; i += 1) {
+    line("%s[%lu] = %s;", argv, (unsigned long)i, args[i]);
+  }
+  if (dest == NULL) {
+    line("return runtime_tail(%s, %lu, %s);", fn, (unsigned long)argc, argv);
+  } else {
+    line("%s = runtime_call(%s, %lu, %s);", dest, fn, (unsigned long)argc,
+         argv);
+  }
+  free(argv);
+}
+
+struct open_coded {
+  const char *name;
+  size_t argc;
+  const char *test;
+  const char *value;
+};
+
+/* the arguments are substituted in order into test and value */
+static struct open_coded open_map[] = {
+  { .name = "+", .argc = 2,
+    .test = "IS(%s, FIXNUM) && IS(%s, FIXNUM)",
+    .value = "exp_make_fixnum(FIXNUM_VALUE(%s) + FIXNUM_VALUE(%s))" },
+  { .name = "-", .argc = 2,
+    .test = "IS(%s, FIXNUM) && IS(%s, FIXNUM)",
+    .value = "exp_make_fixnum(FIXNUM_VALUE(%s) - FIXNUM_VALUE(%s))" },
+  { .name = "=", .argc = 2,
+    .test = "IS(%s, FIXNUM) && IS(%s, FIXNUM)",
+    .value = "%s == %s ? TRUE : FALSE" },
+  { .name = ">", .argc = 2,
+    .test = "IS(%s, FIXNUM) && IS(%s, FIXNUM)",
+    .value = "FIXNUM_VALUE(%s) > FIXNUM_VALUE(%s) ? TRUE : FALSE" },
+  { .name = "eq?", .argc = 2,
+    .test = "1",
+    .value = "%s == %s ? TRUE : FALSE" },
+  { .name = "cons", .argc = 2,
+    .test = "1",
+    .value = "exp_make_pair(%s, %s)" },
+  { .name = "car", .argc = 1,
+    .test = "IS(%s, PAIR)",
+    .value = "CAR(%s)" },
+  { .name = "cdr", .argc = 1,
+    .test = "IS(%s, PAIR)",
+    .value = "CDR(%s)" }
+};
+
+#define NELEM(arr) ((sizeof arr) / (sizeof arr[0]))
+
+/* as in compile.c, a builtin whose global is still the original */
+/* is open-coded, with a check at run time in case that changes */
+static struct open_coded *open_coded(struct exp *node) {
+  struct exp *fn = node->value.node.a;
+  struct exp *cell;
+  size_t i;
+  if (fn->value.node.type != NODE_GLOBAL) {
+    return NULL;
+  }
+  cell = fn->value.node.c;
+  if (!cell->value.cell.original) {
+    return NULL;
+  }
+  for (i = 0; i < NELEM(open_map); i += 1) {
+    if (open_map[i].argc == node->value.node.slot &&
+        !strcmp(open_map[i].name, cell->value.cell.symbol->value.symbol)) {
+      return &open_map[i];
+    }
+  }
+  return NULL;
+}
+
+static void gen_apply(struct exp *node, const char *dest) {
+  struct open_coded *open = open_coded(node);
+  struct exp *args = node->value.node.b;
+  size_t argc = node->value.node.slot;
+  char *names[3] = { NULL, NULL, NULL };
+  char *fn;
+  size_t i;
+  open_block();
+  if (open != NULL) {
+    size_t cell = global(node->value.node.a->value.node.c);
+    char *test;
+    for (i = 0; i < argc; i += 1, args = CDR(args)) {
+      names[i] = temp();
+      gen(CAR(args), names[i]);
+    }
+    test = format(open->test, names[0], names[1]);
+    line("if (g[%lu]->value.cell.original && %s) {", (unsigned long)cell,
+         test);
+    aot.indent += 1;
+    result(dest, open->value, names[0], names[1]);
+    aot.indent -= 1;
+    line("} else {");
+    aot.indent += 1;
+    fn = format("RUNTIME_GLOBAL(g[%lu])", (unsigned long)cell);
+    call(fn, argc, (const char **)names, dest);
+    aot.indent -= 1;
+    line("}");
+    free(test);
+  } else {
+    char *array = format("t%u", aot.temps);
+    aot.temps += 1;
+    fn = temp();
+    gen(node->value.node.a, fn);
+    line("struct exp **%s = runtime_push(%lu);", array,
+         (unsigned long)argc);
+    for (i = 0; i < argc; i += 1, args = CDR(args)) {
+      char *arg = format("%s[%lu]", array, (unsigned long)i);
+      gen(CAR(args), arg);
+      free(arg);
+    }
+    if (dest == NULL) {
+      line("return runtime_tail(%s, %lu, %s);", fn, (unsigned long)argc,
+           array);
+    } else {
+      line("%s = runtime_call(%s, %lu, %s);", dest, fn,
+           (unsigned long)argc, array);
+    }
+    free(array);
+  }
+  for (i = 0; i < 3; i += 1) {
+    free(names[i]);
+  }
+  free(fn);
+  close_block();
+}
+
+static void gen(struct exp *node, const char *dest) {
+  struct exp *a = node->value.node.a;
+  struct exp *b = node->value.node.b;
+  struct exp *c = node->value.node.c;
+  char *value;
+  char *var;
+  switch (node->value.node.type) {
+  case NODE_CONST:
+    result(dest, "k[%lu]", (unsigned long)constant(a));
+    break;
+  case NODE_LOCAL:
+  case NODE_FREE:
+    var = slot(node, 1);
+    result(dest, "RUNTIME_BOUND(%s)", var);
+    free(var);
+    break;
+  case NODE_GLOBAL:
+    result(dest, "RUNTIME_GLOBAL(g[%lu])", (unsigned long)global(c));
+    break;
+  case NODE_SET_LOCAL:
+  case NODE_SET_FREE:
+  case NODE_DEFINE_LOCAL:
+    open_block();
+    value = temp();
+    gen(b, value);
+    if (node->value.node.type == NODE_DEFINE_LOCAL) {
+      line("exp_name(%s, k[%lu]);", value, (unsigned long)constant(a));
+    }
+    if (node->value.node.boxed) {
+      /* a store into a box is a store into an exp, see GC_WRITE */
+      var = slot(node, 0);
+      line("GC_WRITE(%s);", var);
+      free(var);
+    }
+    var = slot(node, 1);
+    line("%s = %s;", var, value);
+    result(dest, "OK");
+    free(var);
+    free(value);
+    close_block();
+    break;
+  case NODE_SET_GLOBAL:
+  case NODE_DEFINE_GLOBAL:
+    open_block();
+    value = temp();
+    gen(b, value);
+    if (node->value.node.type == NODE_SET_GLOBAL) {
+      line("env_cell_value(g[%lu]);", (unsigned long)global(c));
+    } else {
+      line("exp_name(%s, k[%lu]);", value, (unsigned long)constant(a));
+    }
+    line("ENV_CELL_SET(g[%lu], %s);", (unsigned long)global(c), value);
+    result(dest, "OK");
+    free(value);
+    close_block();
+    break;
+  case NODE_IF:
+    open_block();
+    value = temp();
+    gen(a, value);
+    line("if (%s != FALSE) {", value);
+    aot.indent += 1;
+    gen(b, dest);
+    aot.indent -= 1;
+    line("} else {");
+    aot.indent += 1;
+    gen(c, dest);
+    aot.indent -= 1;
+    line("}");
+    free(value);
+    close_block();
+    break;
+  case NODE_OR:
+    {
+      int depth = 0;
+      open_block();
+      value = temp();
+      for (; CDR(a) != NIL; a = CDR(a)) {
+        gen(CAR(a), value);
+        line("if (%s != FALSE) {", value);
+        aot.indent += 1;
+        result(dest, "%s", value);
+        aot.indent -= 1;
+        line("} else {");
+        aot.indent += 1;
+        depth += 1;
+      }
+      gen(CAR(a), dest);
+      for (; depth > 0; depth -= 1) {
+        close_block();
+      }
+      free(value);
+      close_block();
+    }
+    break;
+  case NODE_LAMBDA:
+    {
+      struct exp *captures = node->value.node.d;
+      size_t fn = index_of(aot.lambdas, node);
+      size_t lambda = constant(node);
+      size_t i;
+      if (captures == NIL) {
+        result(dest, "runtime_closure(k[%lu], &p%lu, NULL)",
+               (unsigned long)lambda, (unsigned long)fn);
+        break;
+      }
+      open_block();
+      line("struct env *e = env_new(%lu);",
+           (unsigned long)exp_list_length(captures));
+      for (i = 0; captures != NIL; captures = CDR(captures), i += 1) {
+        /* boxes are copied, not their values */
+        var = slot(CAR(captures), 0);
+        line("e->slots[%lu] = %s;", (unsigned long)i, var);
+        free(var);
+      }
+      result(dest, "runtime_closure(k[%lu], &p%lu, e)",
+             (unsigned long)lambda, (unsigned long)fn);
+      close_block();
+    }
+    break;
+  case NODE_BEGIN:
+    open_block();
+    value = temp();
+    for (; CDR(a) != NIL; a = CDR(a)) {
+      gen(CAR(a), value);
+    }
+    line("(void)%s;", value);
+    gen(CAR(a), dest);
+    free(value);
+    close_block();
+    break;
+  case NODE_BOX:
+    line("l[%u] = env_box(l[%u]);", node->value.node.slot,
+         node->value.node.slot);
+    result(dest, "OK");
+    break;
+  case NODE_APPLY:
+    gen_apply(node, dest);
+    break;
+  default:
+    err_error("aot: bad node type", NULL);
+    break;
+  }
+}
+
+static void function(const char *name, size_t n, struct exp *body) {
+  fprintf(aot.out, "static struct exp *%s%lu(struct exp **l, "
+          "struct env *f) {\n", name, (unsigned long)n);
+  aot.indent = 1;
+  aot.temps = 0;
+  gen(body, NULL);
+  fprintf(aot.out, "}\n\n");
+}
+
+/* as a c string literal. question marks are escaped so that no */
+/* trigraphs slip in. */
+static void literal(FILE *out, const char *str) {
+  fputc('"', out);
+  for (; *str != '\0'; str += 1) {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\' || c == '?') {
+      fprintf(out, "\\%c", c);
+    } else if (c >= ' ' && c <= '~') {
+      fputc(c, out);
+    } else {
+      fprintf(out, "\\%03o", c);
+    }
+  }
+  fputc('"', out);
+}
+
+static void build(FILE *out, size_t i) {
+  struct exp *exp = vector_get(aot.constants, i);
+  fprintf(out, "  k[%lu] = ", (unsigned long)i);
+  if (exp == NIL) {
+    fprintf(out, "NIL");
+  } else if (exp == OK) {
+    fprintf(out, "OK");
+  } else if (exp == TRUE) {
+    fprintf(out, "TRUE");
+  } else if (exp == FALSE) {
+    fprintf(out, "FALSE");
+  } else {
+    switch (TYPE(exp)) {
+    case FIXNUM:
+      fprintf(out, "exp_make_fixnum(%ldL)", FIXNUM_VALUE(exp));
+      break;
+    case CHARACTER:
+      fprintf(out, "exp_make_character(%d)", CHARACTER_VALUE(exp));
+      break;
+    case SYMBOL:
+      fprintf(out, "exp_make_symbol(");
+      literal(out, exp->value.symbol);
+      fprintf(out, ")");
+      break;
+    case STRING:
+      fprintf(out, "runtime_string(");
+      literal(out, exp->value.string);
+      fprintf(out, ")");
+      break;
+    case PAIR:
+      fprintf(out, "exp_make_pair(k[%lu], k[%lu])",
+              (unsigned long)index_of(aot.constants, CAR(exp)),
+              (unsigned long)index_of(aot.constants, CDR(exp)));
+      break;
+    case VECTOR:
+    case BYTEVECTOR:
+      {
+        struct vector *items = IS(exp, VECTOR) ?
+          exp->value.vector : exp->value.bytevector;
+        size_t j;
+        fprintf(out, "exp_make_%svector(%lu", IS(exp, VECTOR) ? "" : "byte",
+                (unsigned long)vector_length(items));
+        for (j = 0; j < vector_length(items); j += 1) {
+          fprintf(out, ", k[%lu]",
+                  (unsigned long)index_of(aot.constants,
+                                          vector_get(items, j)));
+        }
+        fprintf(out, ")");
+      }
+      break;
+    case NODE:
+      fprintf(out, "runtime_lambda(k[%lu], %u)",
+              (unsigned long)index_of(aot.constants, exp->value.node.a),
+              exp->value.node.slot);
+      break;
+    default:
+      err_error("aot: cannot compile constant", exp);
+      break;
+    }
+  }
+  fprintf(out, ";\n");
+}
+
+static void write_program(FILE *out, FILE *code, size_t count) {
+  size_t nconsts = vector_length(aot.constants);
+  size_t nglobals = vector_length(aot.globals);
+  size_t i;
+  int c;
+  fprintf(out, "/* generated by yoshi -c. link against lib/libyoshi.a */\n");
+  fprintf(out, "#include \"runtime.h\"\n\n");
+  fprintf(out, "static struct exp *k[%lu];\n",
+          (unsigned long)(nconsts > 0 ? nconsts : 1));
+  fprintf(out, "static struct exp *g[%lu];\n\n",
+          (unsigned long)(nglobals > 0 ? nglobals : 1));
+  for (i = 0; i < vector_length(aot.lambdas); i += 1) {
+    fprintf(out, "static struct exp *p%lu(struct exp **l, "
+            "struct env *f);\n", (unsigned long)i);
+  }
+  fprintf(out, "\n");
+  rewind(code);
+  while ((c = fgetc(code)) != EOF) {
+    fputc(c, out);
+  }
+  fprintf(out, "static void constants(void) {\n");
+  for (i = 0; i < nconsts; i += 1) {
+    build(out, i);
+  }
+  for (i = 0; i < nglobals; i += 1) {
+    struct exp *cell = vector_get(aot.globals, i);
+    fprintf(out, "  g[%lu] = env_cell(exp_make_symbol(", (unsigned long)i);
+    literal(out, cell->value.cell.symbol->value.symbol);
+    fprintf(out, "));\n");
+  }
+  fprintf(out, "  runtime_keep(%lu, k);\n}\n\n", (unsigned long)nconsts);
+  fprintf(out, "int main(int argc, char **argv) {\n");
+  fprintf(out, "  runtime_init(argc, argv);\n");
+  fprintf(out, "  constants();\n");
+  for (i = 0; i < count; i += 1) {
+    fprintf(out, "  runtime_toplevel(&t%lu);\n", (unsigned long)i);
+  }
+  fprintf(out, "  return 0;\n}\n");
+}
+
+/* the interpreter runs each form before it reads the next, so a */
+/* builtin that is assigned anywhere in the program must not be */
+/* folded or open-coded anywhere. like analyze_assigned, this */
+/* ignores shadowing. */
+static void unguard(struct exp *exp) {
+  if (!IS(exp, PAIR) || exp_list_tagged(exp, KEYWORD(QUOTE))) {
+    return;
+  }
+  if ((exp_list_tagged(exp, KEYWORD(SET)) ||
+       exp_list_tagged(exp, KEYWORD(DEFINE))) && IS(CADR(exp), SYMBOL)) {
+    env_cell(CADR(exp))->value.cell.original = 0;
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    unguard(CAR(exp));
+  }
+}
+
+/* a form that cannot be read, expanded or analyzed is compiled */
+/* to raise the same error when it runs, as the interpreter would */
+/* report it in turn. the error is also shown now. */
+static char *broken(void) {
+  char *msg = err_message();
+  fprintf(stderr, "error: %s\n", msg);
+  return msg;
+}
+
+int aot_compile(const char *path) {
+  struct vector *nodes = vector_new(64);
+  struct vector *errors = vector_new(64);
+  struct input *input = config_next_input();
+  struct exp *exp;
+  FILE *code;
+  FILE *out;
+  size_t i;
+  while (input != NULL) {
+    if (!err_init()) {
+      if ((exp = read(input)) == NULL) {
+        input = config_next_input();
+        continue;
+      }
+      vector_push(nodes, expand(exp));
+      vector_push(errors, NULL);
+    } else {
+      vector_push(nodes, NIL);
+      vector_push(errors, broken());
+    }
+  }
+  for (i = 0; i < vector_length(nodes); i += 1) {
+    unguard(vector_get(nodes, i));
+  }
+  for (i = 0; i < vector_length(nodes); i += 1) {
+    if (vector_get(errors, i) == NULL) {
+      if (!err_init()) {
+        vector_put(nodes, i, analyze(optimize(vector_get(nodes, i))));
+      } else {
+        vector_put(nodes, i, NIL);
+        vector_put(errors, i, broken());
+      }
+    }
+  }
+  if (err_init()) {
+    char *msg = err_message();
+    fprintf(stderr, "error: %s\n", msg);
+    free(msg);
+    return 1;
+  }
+  aot.constants = vector_new(256);
+  aot.globals = vector_new(256);
+  aot.lambdas = vector_new(64);
+  code = tmpfile();
+  err_ensure(code != NULL, "aot: cannot create a temporary file", NULL);
+  aot.out = code;
+  for (i = 0; i < vector_length(nodes); i += 1) {
+    if (vector_get(errors, i) != NULL) {
+      fprintf(code, "static struct exp *t%lu(struct exp **l, "
+              "struct env *f) {\n  return runtime_error(",
+              (unsigned long)i);
+      literal(code, vector_get(errors, i));
+      fprintf(code, ");\n}\n\n");
+    } else {
+      function("t", i, vector_get(nodes, i));
+    }
+  }
+  /* lambdas are found as they are generated, so this list grows */
+  for (i = 0; i < vector_length(aot.lambdas); i += 1) {
+    struct exp *lambda = vector_get(aot.lambdas, i);
+    function("p", i, lambda->value.node.b);
+  }
+  out = path != NULL ? fopen(path, "w") : stdout;
+  err_ensure(out != NULL, "aot: cannot open output file", NULL);
+  write_program(out, code, vector_length(nodes));
+  fclose(code);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
+
+#undef NELEM
@@ -0,0 +1,7 @@
+#ifndef AOT_H
+#define AOT_H
+/* compiles the stdlib and the input files to a c program, written */
+/* to path or stdout, that links against the runtime library. */
+/* returns the exit status for main. */
+extern int aot_compile(const char *path);
+#endif
@@ -1,267 +1,186 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "builtin.h"
 #include "config.h"
+#include "cont.h"
 #include "exp.h"
 #include "env.h"
 #include "err.h"
 #include "gc.h"
 #include "expand.h"
 #include "eval.h"
+#include "optimize.h"
 #include "util/vector.h"
 
-static struct exp *fn_number_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "number? requires exactly one argument, got", args);
-  return IS(CAR(args), FIXNUM) ? TRUE : FALSE;
+/* arity and argument types are declared in builtin_defall and */
+/* checked before a builtin is called, so the builtins themselves */
+/* only check what their signature cannot express */
+
+static struct exp *fn_number_p(size_t argc, struct exp **argv) {
+  return IS(argv[0], FIXNUM) ? TRUE : FALSE;
 }
 
-static struct exp *fn_pair_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "pair? requires exactly one argument, got", args);
-  return IS(CAR(args), PAIR) ? TRUE : FALSE;
+static struct exp *fn_pair_p(size_t argc, struct exp **argv) {
+  return IS(argv[0], PAIR) ? TRUE : FALSE;
 }
 
-static struct exp *fn_vector_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "vector? requires exactly one argument, got", args);
-  return IS(CAR(args), VECTOR) ? TRUE : FALSE;
+static struct exp *fn_vector_p(size_t argc, struct exp **argv) {
+  return IS(argv[0], VECTOR) ? TRUE : FALSE;
 }
 
-static struct exp *fn_symbol_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "symbol? requires exactly one argument, got", args);
-  return IS(CAR(args), SYMBOL) ? TRUE : FALSE;
+static struct exp *fn_symbol_p(size_t argc, struct exp **argv) {
+  return IS(argv[0], SYMBOL) ? TRUE : FALSE;
 }
 
-static struct exp *fn_string_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "string? requires exactly one argument, got", args);
-  return IS(CAR(args), STRING) ? TRUE : FALSE;
+static struct exp *fn_string_p(size_t argc, struct exp **argv) {
+  return IS(argv[0], STRING) ? TRUE : FALSE;
 }
 
-static struct exp *fn_procedure_p(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "procedure? requires exactly one argument, got", args);
-  struct exp *obj = CAR(args);
-  return (IS(obj, FUNCTION) || IS(obj, CLOSURE)) ? TRUE : FALSE;
+static struct exp *fn_procedure_p(size_t argc, struct exp **argv) {
+  struct exp *obj = argv[0];
+  return (IS(obj, FUNCTION) || IS(obj, CLOSURE) ||
+          IS(obj, CONTINUATION)) ? TRUE : FALSE;
 }
 
-static struct exp *fn_add(struct exp *args) {
+static struct exp *fn_add(size_t argc, struct exp **argv) {
   long acc = 0;
-  while (args != NIL) {
-    struct exp *e = CAR(args);
-    err_ensure(IS(e, FIXNUM), "+ requires numeric arguments, got", e);
-    acc += e->value.fixnum;
-    args = CDR(args);
+  size_t i;
+  for (i = 0; i < argc; i += 1) {
+    acc += FIXNUM_VALUE(argv[i]);
   }
   return exp_make_fixnum(acc);
 }
 
-static struct exp *fn_sub(struct exp *args) {
-  size_t len = exp_list_length(args);
-  err_ensure(len > 0, "- requires at least one argument, got", args);
-  err_ensure(IS(CAR(args), FIXNUM),
-             "- requires numeric arguments, got", CAR(args));
-  long acc = CAR(args)->value.fixnum;
-  args = CDR(args);
-  if (len == 1) {
+static struct exp *fn_sub(size_t argc, struct exp **argv) {
+  long acc = FIXNUM_VALUE(argv[0]);
+  size_t i;
+  if (argc == 1) {
     acc *= -1;
   } else {
-    while (args != NIL) {
-      err_ensure(IS(CAR(args), FIXNUM),
-                 "- requires numeric arguments, got", CAR(args));
-      acc -= CAR(args)->value.fixnum;
-      args = CDR(args);
+    for (i = 1; i < argc; i += 1) {
+      acc -= FIXNUM_VALUE(argv[i]);
     }
   }
   return exp_make_fixnum(acc);
 }
 
-static struct exp *fn_mul(struct exp *args) {
+static struct exp *fn_mul(size_t argc, struct exp **argv) {
   long acc = 1;
-  while (args != NIL) {
-    struct exp *e = CAR(args);
-    err_ensure(IS(e, FIXNUM), "* requires numeric arguments, got", e);
-    acc *= e->value.fixnum;
-    args = CDR(args);
+  size_t i;
+  for (i = 0; i < argc; i += 1) {
+    acc *= FIXNUM_VALUE(argv[i]);
   }
   return exp_make_fixnum(acc);
 }
 
-static struct exp *fn_div(struct exp *args) {
-  err_ensure(exp_list_length(args) == 2,
-             "div requires exactly two arguments, got", args);
-  struct exp *a = CAR(args);
-  struct exp *b = CADR(args);
-  err_ensure(IS(a, FIXNUM) && IS(b, FIXNUM),
-             "div requires numeric arguments, got", args);
-  return exp_make_fixnum(a->value.fixnum / b->value.fixnum);
-}
-
-static struct exp *fn_mod(struct exp *args) {
-  err_ensure(exp_list_length(args) == 2,
-             "mod requires exactly two arguments, got", args);
-  struct exp *a = CAR(args);
-  struct exp *b = CADR(args);
-  err_ensure(IS(a, FIXNUM) && IS(b, FIXNUM),
-             "mod requires numeric arguments, got", args);
-  return exp_make_fixnum(a->value.fixnum % b->value.fixnum);
-}
-
-static struct exp *fn_gt(struct exp *args) {
-  err_ensure(exp_list_length(args) == 2,
-             "> requires exactly two arguments, got", args);
-  struct exp *a = CAR(args);
-  struct exp *b = CADR(args);
-  err_ensure(IS(a, FIXNUM) && IS(b, FIXNUM),
-             "> requires numeric arguments, got", args);
-  return a->value.fixnum > b->value.fixnum ? TRUE : FALSE;
-}
-
-static struct exp *fn_eq(struct exp *args) {
-  size_t len = exp_list_length(args);
-  err_ensure(len >= 2, "= requires at least two arguments, got", args);
-  struct exp *first = CAR(args);
-  err_ensure(IS(first, FIXNUM), "= requires numeric arguments, got", first);
-  args = CDR(args);
-  while (args != NIL) {
-    err_ensure(IS(CAR(args), FIXNUM),
-               "= requires numeric arguments, got", CAR(args));
-    if (first->value.fixnum != CAR(args)->value.fixnum) {
+static struct exp *fn_div(size_t argc, struct exp **argv) {
+  return exp_make_fixnum(FIXNUM_VALUE(argv[0]) / FIXNUM_VALUE(argv[1]));
+}
+
+static struct exp *fn_mod(size_t argc, struct exp **argv) {
+  return exp_make_fixnum(FIXNUM_VALUE(argv[0]) % FIXNUM_VALUE(argv[1]));
+}
+
+static struct exp *fn_gt(size_t argc, struct exp **argv) {
+  return FIXNUM_VALUE(argv[0]) > FIXNUM_VALUE(argv[1]) ? TRUE : FALSE;
+}
+
+static struct exp *fn_eq(size_t argc, struct exp **argv) {
+  size_t i;
+  for (i = 1; i < argc; i += 1) {
+    if (FIXNUM_VALUE(argv[0]) != FIXNUM_VALUE(argv[i])) {
       return FALSE;
     }
-    args = CDR(args);
   }
   return TRUE;
 }
 
-static struct exp *fn_eq_p(struct exp *args) {
-  if (exp_list_length(args) < 2) {
-    return TRUE;
-  } else {
-    struct exp *a = CAR(args);
-    struct exp *b = CADR(args);
-    if (a->type != b->type) {
+/* fixnums, characters and symbols are unique, */
+/* so identity is enough for all of them */
+static struct exp *fn_eq_p(size_t argc, struct exp **argv) {
+  size_t i;
+  for (i = 1; i < argc; i += 1) {
+    if (argv[i - 1] != argv[i]) {
       return FALSE;
-    } else {
-      switch (a->type) {
-      case FIXNUM:
-        if (a->value.fixnum != b->value.fixnum) {
-          return FALSE;
-        }
-        break;
-      case SYMBOL:
-        if (strcmp(a->value.symbol, b->value.symbol) != 0) {
-          return FALSE;
-        }
-        break;
-      default:
-        if (a != b) {
-          return FALSE;
-        }
-        break;
-      }
     }
-    return fn_eq_p(CDR(args));
   }
+  return TRUE;
 }
 
-static struct exp *fn_cons(struct exp *args) {
-  err_ensure(exp_list_length(args) == 2,
-             "cons requires exactly two arguments, got", args);
-  return exp_make_pair(CAR(args), CADR(args));
+static struct exp *fn_cons(size_t argc, struct exp **argv) {
+  return exp_make_pair(argv[0], argv[1]);
 }
 
-static struct exp *fn_car(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "car requires exactly one argument, got", args);
-  args = CAR(args);
-  err_ensure(IS(args, PAIR), "car requires a pair argument, got", args);
-  return CAR(args);
+static struct exp *fn_car(size_t argc, struct exp **argv) {
+  return CAR(argv[0]);
 }
 
-static struct exp *fn_cdr(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "cdr requires exactly one argument, got", args);
-  args = CAR(args);
-  err_ensure(IS(args, PAIR), "cdr requires a pair argument, got", args);
-  return CDR(args);
+static struct exp *fn_cdr(size_t argc, struct exp **argv) {
+  return CDR(argv[0]);
 }
 
-static struct exp *fn_make_vector(struct exp *args) {
-  size_t len = exp_list_length(args);
-  err_ensure(len == 1 || len == 2,
-             "make-vector requires exactly one or two arguments, got", args);
-  struct exp *k = CAR(args);
-  err_ensure(k->type == FIXNUM,
-             "make-vector requires a numeric argument, got", k);
-  struct exp *fill = len == 2 ? CADR(args) : NIL;
+static struct exp *fn_symbol_to_string(size_t argc, struct exp **argv) {
+  char *str = malloc(strlen(argv[0]->value.symbol) + 1);
+  strcpy(str, argv[0]->value.symbol);
+  return exp_make_string(str);
+}
+
+static struct exp *fn_string_to_symbol(size_t argc, struct exp **argv) {
+  return exp_make_symbol(argv[0]->value.string);
+}
+
+static struct exp *fn_make_vector(size_t argc, struct exp **argv) {
+  struct exp *k = argv[0];
+  struct exp *fill = argc == 2 ? argv[1] : NIL;
   struct exp *v = exp_make_vector(0);
   size_t i;
-  for (i = 0; i < k->value.fixnum; i += 1) {
+  for (i = 0; i < FIXNUM_VALUE(k); i += 1) {
     vector_push(v->value.vector, fill);
   }
   return v;
 }
 
-static struct exp *fn_vector_length(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "vector-length requires exactly one argument, got", args);
-  struct exp *vector = CAR(args);
-  err_ensure(IS(vector, VECTOR),
-             "vector-length requires a vector argument, got", vector);
-  return exp_make_fixnum(vector_length(vector->value.vector));
-}
-
-static struct exp *fn_vector_ref(struct exp *args) {
-  err_ensure(exp_list_length(args) == 2,
-             "vector-ref requires exactly two arguments, got", args);
-  struct exp *vector = CAR(args);
-  struct exp *k = CADR(args);
-  err_ensure(IS(vector, VECTOR),
-             "vector-ref requires a vector argument, got", vector);
-  err_ensure(IS(k, FIXNUM),
-             "vector-ref requires a numeric index, got", k);
-  size_t i = k->value.fixnum;
+static struct exp *fn_vector_length(size_t argc, struct exp **argv) {
+  return exp_make_fixnum(vector_length(argv[0]->value.vector));
+}
+
+static struct exp *fn_vector_ref(size_t argc, struct exp **argv) {
+  struct exp *vector = argv[0];
+  struct exp *k = argv[1];
+  size_t i = FIXNUM_VALUE(k);
   err_ensure(i >= 0 && i < vector_length(vector->value.vector),
              "vector-ref requires a valid index, got", k);
   return vector_get(vector->value.vector, i);
 }
 
-static struct exp *fn_vector_set(struct exp *args) {
-  err_ensure(exp_list_length(args) == 3,
-             "vector-set! requires exactly three arguments, got", args);
-  struct exp *vector = CAR(args);
-  struct exp *k = CADR(args);
-  struct exp *obj = CADDR(args);
-  err_ensure(IS(vector, VECTOR),
-             "vector-set! requires a vector argument, got", vector);
-  err_ensure(IS(k, FIXNUM),
-             "vector-set! requires a numeric index, got", k);
-  size_t i = k->value.fixnum;
+static struct exp *fn_vector_set(size_t argc, struct exp **argv) {
+  struct exp *vector = argv[0];
+  struct exp *k = argv[1];
+  struct exp *obj = argv[2];
+  size_t i = FIXNUM_VALUE(k);
   err_ensure(i >= 0 && i < vector_length(vector->value.vector),
              "vector-set! requires a valid index, got", k);
+  GC_WRITE(vector);
   vector_put(vector->value.vector, i, obj);
   return OK;
 }
 
-static struct exp *fn_eval(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "eval requires exactly one argument, got", args);
-  return eval(expand(CAR(args)), &global_env);
+static struct exp *fn_eval(size_t argc, struct exp **argv) {
+  return eval(expand(argv[0]));
+}
+
+static struct exp *fn_expand(size_t argc, struct exp **argv) {
+  return expand(argv[0]);
 }
 
-static struct exp *fn_expand(struct exp *args) {
-  err_ensure(exp_list_length(args) == 1,
-             "expand requires exactly one argument, got", args);
-  return expand(CAR(args));
+static struct exp *fn_optimize(size_t argc, struct exp **argv) {
+  return optimize(expand(argv[0]));
 }
 
-static struct exp *fn_about(struct exp *args) {
-  err_ensure(exp_list_length(args) == 0,
-             "about requires exactly zero arguments, got", args);
+static struct exp *fn_about(size_t argc, struct exp **argv) {
   const char *about = ("I'm not much more than an interpreter, "
                        "and not very good at telling stories.");
   char *buf = malloc(strlen(about) + 1);
@@ -269,40 +188,199 @@ static struct exp *fn_about(struct exp *args) {
   return exp_make_string(buf);
 }
 
-static void define_primitive(struct env *env, char *symbol,
-                             struct exp *(*function)(struct exp *args)) {
+static const char *count_name(size_t n) {
+  static const char *names[] = { "zero", "one", "two", "three" };
+  static char buf[32];
+  if (n < sizeof names / sizeof names[0]) {
+    return names[n];
+  }
+  sprintf(buf, "%lu", (unsigned long)n);
+  return buf;
+}
+
+static const char *type_name(int type) {
+  switch (type) {
+  case FIXNUM:
+    return "numeric";
+  case PAIR:
+    return "pair";
+  case SYMBOL:
+    return "symbol";
+  case STRING:
+    return "string";
+  case VECTOR:
+    return "vector";
+  default:
+    return "valid";
+  }
+}
+
+int builtin_arity_ok(struct exp *fn, size_t argc) {
+  return (argc >= fn->value.function.min_args &&
+          (fn->value.function.max_args == BUILTIN_VARIADIC ||
+           argc <= fn->value.function.max_args));
+}
+
+void builtin_check_arity(struct exp *fn, size_t argc, struct exp **argv) {
+  if (!builtin_arity_ok(fn, argc)) {
+    char msg[128];
+    unsigned char min = fn->value.function.min_args;
+    unsigned char max = fn->value.function.max_args;
+    if (min == max) {
+      sprintf(msg, "%.32s requires exactly %s argument%s, got",
+              fn->value.function.name, count_name(min), min == 1 ? "" : "s");
+    } else if (max == BUILTIN_VARIADIC) {
+      sprintf(msg, "%.32s requires at least %s argument%s, got",
+              fn->value.function.name, count_name(min), min == 1 ? "" : "s");
+    } else {
+      sprintf(msg, "%.32s requires %s to ", fn->value.function.name,
+              count_name(min));
+      sprintf(msg + strlen(msg), "%s arguments, got", count_name(max));
+    }
+    err_error(msg, exp_list_from(argc, argv));
+  }
+}
+
+static int arg_type(struct exp *fn, size_t i) {
+  const unsigned char *types = fn->value.function.types;
+  return types[i < FUNCTION_TYPES_MAX ? i : FUNCTION_TYPES_MAX - 1];
+}
+
+static int type_ok(struct exp *fn, size_t i, struct exp *arg) {
+  int type = arg_type(fn, i);
+  return type == BUILTIN_ANY || IS(arg, type);
+}
+
+int builtin_types_ok(struct exp *fn, size_t argc, struct exp **argv) {
+  size_t i;
+  for (i = 0; i < argc; i += 1) {
+    if (!type_ok(fn, i, argv[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void builtin_check_types(struct exp *fn, size_t argc, struct exp **argv) {
+  size_t i;
+  for (i = 0; i < argc; i += 1) {
+    if (!type_ok(fn, i, argv[i])) {
+      int type = arg_type(fn, i);
+      char msg[128];
+      if (fn->value.function.max_args == BUILTIN_VARIADIC) {
+        sprintf(msg, "%.32s requires %s arguments, got",
+                fn->value.function.name, type_name(type));
+      } else {
+        sprintf(msg, "%.32s requires a %s argument, got",
+                fn->value.function.name, type_name(type));
+      }
+      err_error(msg, argv[i]);
+    }
+  }
+}
+
+struct exp *builtin_apply(struct exp *fn, size_t argc, struct exp **argv) {
+  builtin_check_arity(fn, argc, argv);
+  builtin_check_types(fn, argc, argv);
+  return (*fn->value.function.fn)(argc, argv);
+}
+
+/* the last type given applies to all later arguments */
+static void define_primitive(char *symbol,
+                             struct exp *(*function)(size_t argc,
+                                                     struct exp **argv),
+                             unsigned char min_args, unsigned char max_args,
+                             const unsigned char *types, size_t ntypes) {
   struct exp *e = (*gc->alloc_exp)(FUNCTION);
+  size_t i;
   e->value.function.fn = function;
   e->value.function.name = malloc(strlen(symbol) + 1);
   strcpy(e->value.function.name, symbol);
-  env_define(env, exp_make_atom(symbol), e);
-}
-
-void builtin_defall(struct env *env) {
-#define DEFUN(sym, fn) define_primitive(env, sym, &fn)
-  DEFUN("number?", fn_number_p);
-  DEFUN("pair?", fn_pair_p);
-  DEFUN("vector?", fn_vector_p);
-  DEFUN("symbol?", fn_symbol_p);
-  DEFUN("string?", fn_string_p);
-  DEFUN("procedure?", fn_procedure_p);
-  DEFUN("+", fn_add);
-  DEFUN("-", fn_sub);
-  DEFUN("*", fn_mul);
-  DEFUN("div", fn_div);
-  DEFUN("mod", fn_mod);
-  DEFUN(">", fn_gt);
-  DEFUN("=", fn_eq);
-  DEFUN("eq?", fn_eq_p);
-  DEFUN("cons", fn_cons);
-  DEFUN("car", fn_car);
-  DEFUN("cdr", fn_cdr);
-  DEFUN("make-vector", fn_make_vector);
-  DEFUN("vector-length", fn_vector_length);
-  DEFUN("vector-ref", fn_vector_ref);
-  DEFUN("vector-set!", fn_vector_set);
-  DEFUN("eval", fn_eval);
-  DEFUN("expand", fn_expand);
-  DEFUN("about", fn_about);
+  e->value.function.min_args = min_args;
+  e->value.function.max_args = max_args;
+  assert(ntypes <= FUNCTION_TYPES_MAX);
+  for (i = 0; i < FUNCTION_TYPES_MAX; i += 1) {
+    e->value.function.types[i] = types[i < ntypes ? i : ntypes - 1];
+  }
+  env_define(exp_make_atom(symbol), e);
+  env_cell(exp_make_atom(symbol))->value.cell.original = 1;
+}
+
+/* the collector's stats as an association list, with times in */
+/* microseconds, since there are only fixnums */
+static struct exp *fn_gc_stats(size_t argc, struct exp **argv) {
+  struct gc_stats stats;
+  struct {
+    const char *name;
+    long value;
+  } fields[8];
+  struct exp *alist = NIL;
+  size_t i;
+  gc_stats(&stats);
+  fields[0].name = "collections";
+  fields[0].value = stats.collections;
+  fields[1].name = "bytes-allocated";
+  fields[1].value = stats.bytes_allocated;
+  fields[2].name = "objects-allocated";
+  fields[2].value = stats.objects_allocated;
+  fields[3].name = "live-bytes";
+  fields[3].value = stats.live_bytes;
+  fields[4].name = "live-objects";
+  fields[4].value = stats.live_objects;
+  fields[5].name = "pauses";
+  fields[5].value = stats.pauses;
+  fields[6].name = "pause-total";
+  fields[6].value = (long)(stats.pause_total * 1e6);
+  fields[7].name = "pause-max";
+  fields[7].value = (long)(stats.pause_max * 1e6);
+  for (i = 8; i > 0; i -= 1) {
+    alist = exp_make_pair(exp_make_pair(exp_make_atom(fields[i - 1].name),
+                                        exp_make_fixnum(fields[i - 1].value)),
+                          alist);
+  }
+  return alist;
+}
+
+void builtin_defall(void) {
+#define ANY BUILTIN_ANY
+#define VARIADIC BUILTIN_VARIADIC
+#define DEFUN(sym, fn, min, max, ...)                                   \
+  define_primitive(sym, &fn, min, max,                                  \
+                   (const unsigned char[]){ __VA_ARGS__ },              \
+                   sizeof (const unsigned char[]){ __VA_ARGS__ })
+  DEFUN("number?", fn_number_p, 1, 1, ANY);
+  DEFUN("pair?", fn_pair_p, 1, 1, ANY);
+  DEFUN("vector?", fn_vector_p, 1, 1, ANY);
+  DEFUN("symbol?", fn_symbol_p, 1, 1, ANY);
+  DEFUN("string?", fn_string_p, 1, 1, ANY);
+  DEFUN("procedure?", fn_procedure_p, 1, 1, ANY);
+  DEFUN("call-with-current-continuation", cont_call_cc, 1, 1, ANY);
+  DEFUN("call/cc", cont_call_cc, 1, 1, ANY);
+  DEFUN("call-with-escape-continuation", cont_call_ec, 1, 1, ANY);
+  DEFUN("call/ec", cont_call_ec, 1, 1, ANY);
+  DEFUN("+", fn_add, 0, VARIADIC, FIXNUM);
+  DEFUN("-", fn_sub, 1, VARIADIC, FIXNUM);
+  DEFUN("*", fn_mul, 0, VARIADIC, FIXNUM);
+  DEFUN("div", fn_div, 2, 2, FIXNUM);
+  DEFUN("mod", fn_mod, 2, 2, FIXNUM);
+  DEFUN(">", fn_gt, 2, 2, FIXNUM);
+  DEFUN("=", fn_eq, 2, VARIADIC, FIXNUM);
+  DEFUN("eq?", fn_eq_p, 0, VARIADIC, ANY);
+  DEFUN("cons", fn_cons, 2, 2, ANY);
+  DEFUN("car", fn_car, 1, 1, PAIR);
+  DEFUN("cdr", fn_cdr, 1, 1, PAIR);
+  DEFUN("symbol->string", fn_symbol_to_string, 1, 1, SYMBOL);
+  DEFUN("string->symbol", fn_string_to_symbol, 1, 1, STRING);
+  DEFUN("make-vector", fn_make_vector, 1, 2, FIXNUM, ANY);
+  DEFUN("vector-length", fn_vector_length, 1, 1, VECTOR);
+  DEFUN("vector-ref", fn_vector_ref, 2, 2, VECTOR, FIXNUM);
+  DEFUN("vector-set!", fn_vector_set, 3, 3, VECTOR, FIXNUM, ANY);
+  DEFUN("eval", fn_eval, 1, 1, ANY);
+  DEFUN("expand", fn_expand, 1, 1, ANY);
+  DEFUN("optimize", fn_optimize, 1, 1, ANY);
+  DEFUN("about", fn_about, 0, 0, ANY);
+  DEFUN("gc-stats", fn_gc_stats, 0, 0, ANY);
 #undef DEFUN
+#undef ANY
+#undef VARIADIC
 }
@@ -1,5 +1,18 @@
 #ifndef BUILTIN_H
 #define BUILTIN_H
-struct env;
-extern void builtin_defall(struct env *env);
+#include <stddef.h>
+/* every builtin declares how many arguments it takes and the type */
+/* of each one. these values mark no limit and no type check. */
+#define BUILTIN_VARIADIC 0xff
+#define BUILTIN_ANY 0xff
+struct exp;
+extern void builtin_defall(void);
+extern int builtin_arity_ok(struct exp *fn, size_t argc);
+extern void builtin_check_arity(struct exp *fn, size_t argc,
+                                struct exp **argv);
+extern int builtin_types_ok(struct exp *fn, size_t argc, struct exp **argv);
+extern void builtin_check_types(struct exp *fn, size_t argc,
+                                struct exp **argv);
+extern struct exp *builtin_apply(struct exp *fn, size_t argc,
+                                 struct exp **argv);
 #endif
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "config.h"
+#include "cont.h"
+#include "env.h"
+#include "err.h"
+#include "exp.h"
+#include "gc.h"
+#include "vm.h"
+
+/* the compiler turns analyzed nodes into bytecode for the vm. */
+/* each lambda node is compiled into its own proto, which is kept */
+/* in the node's third slot so closures can find it at call time. */
+
+static void compile_node(struct exp *code, struct exp *node, int tail);
+
+static struct exp *proto_new(void) {
+  struct exp *code = (*gc->alloc_exp)(PROTO);
+  struct proto *proto = calloc(1, sizeof *proto);
+  proto->capacity = 16;
+  proto->code = malloc(proto->capacity * sizeof *proto->code);
+  code->value.proto = proto;
+  return code;
+}
+
+/* depth tracks the stack height at the current instruction so */
+/* the vm can check for room once per call instead of per push */
+static size_t depth;
+
+static void adjust(struct proto *proto, long delta) {
+  depth += delta;
+  if (depth > proto->max_stack) {
+    proto->max_stack = depth;
+  }
+}
+
+static size_t emit_word(struct proto *proto, unsigned int word) {
+  if (proto->length == proto->capacity) {
+    proto->capacity *= 2;
+    proto->code = realloc(proto->code,
+                          proto->capacity * sizeof *proto->code);
+  }
+  proto->code[proto->length] = word;
+  proto->length += 1;
+  return proto->length - 1;
+}
+
+static size_t emit(struct proto *proto, enum opcode op, size_t arg) {
+  err_ensure(arg <= VM_ARG_MAX, "compile: operand too large", NULL);
+  return emit_word(proto, VM_INSTR(op, arg));
+}
+
+static void patch(struct proto *proto, size_t at) {
+  proto->code[at] = VM_INSTR(VM_OP(proto->code[at]), proto->length);
+}
+
+static size_t constant(struct proto *proto, struct exp *exp) {
+  size_t i;
+  for (i = 0; i < proto->nconsts; i += 1) {
+    if (proto->consts[i] == exp) {
+      return i;
+    }
+  }
+  proto->nconsts += 1;
+  proto->consts = realloc(proto->consts,
+                          proto->nconsts * sizeof *proto->consts);
+  proto->consts[proto->nconsts - 1] = exp;
+  return proto->nconsts - 1;
+}
+
+static void compile_return(struct proto *proto, int tail) {
+  if (tail) {
+    emit(proto, OP_RETURN, 0);
+  }
+}
+
+static size_t variable(struct exp *node) {
+  return node->value.node.slot | (node->value.node.boxed ? VM_BOXED : 0);
+}
+
+static struct exp *compile_lambda(struct exp *lambda) {
+  size_t outer = depth;
+  struct exp *code = proto_new();
+  depth = 0;
+  compile_node(code, lambda->value.node.b, 1);
+  /* unreachable, except from a frame that a call/ec in tail */
+  /* position pushes to return through, see vm.c */
+  emit(code->value.proto, OP_RETURN, 0);
+  depth = outer;
+  lambda->value.node.c = code;
+  return code;
+}
+
+/* a call whose operator is a global currently bound to a builtin */
+/* is compiled to PRIM, which skips pushing the operator and calls */
+/* the builtin directly as long as the binding has not changed. */
+/* the arity is checked here, so only a well-formed call is a PRIM. */
+/* call/cc and call/ec need the vm's registers, so they never are. */
+static int is_primitive(struct exp *node, size_t argc) {
+  struct exp *value;
+  if (node->value.node.type != NODE_GLOBAL) {
+    return 0;
+  }
+  value = node->value.node.c->value.cell.value;
+  return value != NULL && IS(value, FUNCTION) &&
+    value->value.function.fn != &cont_call_cc &&
+    value->value.function.fn != &cont_call_ec &&
+    builtin_arity_ok(value, argc);
+}
+
+struct open_coded {
+  const char *name;
+  size_t argc;
+  enum opcode op;
+};
+
+static struct open_coded open_map[] = {
+  { .name = "+", .argc = 2, .op = OP_ADD },
+  { .name = "-", .argc = 2, .op = OP_SUB },
+  { .name = "=", .argc = 2, .op = OP_NUM_EQ },
+  { .name = ">", .argc = 2, .op = OP_GT },
+  { .name = "cons", .argc = 2, .op = OP_CONS },
+  { .name = "car", .argc = 1, .op = OP_CAR },
+  { .name = "cdr", .argc = 1, .op = OP_CDR },
+  { .name = "eq?", .argc = 2, .op = OP_EQ },
+  { .name = "vector-ref", .argc = 2, .op = OP_VECTOR_REF },
+  { .name = "vector-set!", .argc = 3, .op = OP_VECTOR_SET }
+};
+
+#define NELEM(arr) ((sizeof arr) / (sizeof arr[0]))
+
+/* a call to one of the builtins above, while its global still */
+/* holds the original, is compiled to a single instruction. the */
+/* vm rechecks the cell each time, in case it is redefined later. */
+static int compile_open(struct exp *code, struct exp *node, int tail) {
+  struct proto *proto = code->value.proto;
+  struct exp *fn = node->value.node.a;
+  struct exp *args = node->value.node.b;
+  size_t argc = node->value.node.slot;
+  struct exp *cell;
+  size_t i;
+  if (fn->value.node.type != NODE_GLOBAL) {
+    return 0;
+  }
+  cell = fn->value.node.c;
+  if (!cell->value.cell.original) {
+    return 0;
+  }
+  for (i = 0; i < NELEM(open_map); i += 1) {
+    if (open_map[i].argc == argc &&
+        !strcmp(open_map[i].name, cell->value.cell.symbol->value.symbol)) {
+      for (; args != NIL; args = CDR(args)) {
+        compile_node(code, CAR(args), 0);
+      }
+      emit(proto, open_map[i].op, constant(proto, cell));
+      adjust(proto, 1 - (long)argc);
+      compile_return(proto, tail);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#undef NELEM
+
+static void compile_apply(struct exp *code, struct exp *node, int tail) {
+  struct proto *proto = code->value.proto;
+  struct exp *fn = node->value.node.a;
+  struct exp *args = node->value.node.b;
+  size_t argc = node->value.node.slot;
+  int prim;
+  if (compile_open(code, node, tail)) {
+    return;
+  }
+  prim = is_primitive(fn, argc);
+  if (!prim) {
+    compile_node(code, fn, 0);
+  }
+  for (; args != NIL; args = CDR(args)) {
+    compile_node(code, CAR(args), 0);
+  }
+  if (prim) {
+    emit(proto, tail ? OP_TAIL_PRIM : OP_PRIM, argc);
+    emit_word(proto, constant(proto, fn->value.node.c));
+    adjust(proto, 1 - (long)argc);
+  } else {
+    emit(proto, tail ? OP_TAIL_CALL : OP_CALL, argc);
+    adjust(proto, -(long)argc);
+  }
+}
+
+static void compile_node(struct exp *code, struct exp *node, int tail) {
+  struct proto *proto = code->value.proto;
+  struct exp *a = node->value.node.a;
+  struct exp *b = node->value.node.b;
+  struct exp *c = node->value.node.c;
+  switch (node->value.node.type) {
+  case NODE_CONST:
+    emit(proto, OP_CONST, constant(proto, a));
+    adjust(proto, 1);
+    compile_return(proto, tail);
+    break;
+  case NODE_LOCAL:
+    emit(proto, OP_LOCAL, variable(node));
+    adjust(proto, 1);
+    compile_return(proto, tail);
+    break;
+  case NODE_FREE:
+    emit(proto, OP_FREE, variable(node));
+    adjust(proto, 1);
+    compile_return(proto, tail);
+    break;
+  case NODE_GLOBAL:
+    emit(proto, OP_GLOBAL, constant(proto, c));
+    adjust(proto, 1);
+    compile_return(proto, tail);
+    break;
+  case NODE_SET_LOCAL:
+    compile_node(code, b, 0);
+    emit(proto, OP_SET_LOCAL, variable(node));
+    compile_return(proto, tail);
+    break;
+  case NODE_SET_FREE:
+    compile_node(code, b, 0);
+    emit(proto, OP_SET_FREE, variable(node));
+    compile_return(proto, tail);
+    break;
+  case NODE_SET_GLOBAL:
+    compile_node(code, b, 0);
+    emit(proto, OP_SET_GLOBAL, constant(proto, c));
+    compile_return(proto, tail);
+    break;
+  case NODE_DEFINE_LOCAL:
+    compile_node(code, b, 0);
+    emit(proto, OP_DEFINE_LOCAL, variable(node));
+    emit_word(proto, constant(proto, a));
+    compile_return(proto, tail);
+    break;
+  case NODE_DEFINE_GLOBAL:
+    compile_node(code, b, 0);
+    emit(proto, OP_DEFINE_GLOBAL, constant(proto, c));
+    compile_return(proto, tail);
+    break;
+  case NODE_IF:
+    {
+      size_t before = depth;
+      size_t to_alt;
+      size_t to_end = 0;
+      compile_node(code, a, 0);
+      to_alt = emit(proto, OP_JUMP_IF_FALSE, 0);
+      adjust(proto, -1);
+      compile_node(code, b, tail);
+      if (!tail) {
+        to_end = emit(proto, OP_JUMP, 0);
+      }
+      depth = before;
+      patch(proto, to_alt);
+      compile_node(code, c, tail);
+      if (!tail) {
+        patch(proto, to_end);
+      }
+    }
+    break;
+  case NODE_OR:
+    {
+      struct exp *jumps = NIL;
+      size_t before = depth;
+      for (; CDR(a) != NIL; a = CDR(a)) {
+        compile_node(code, CAR(a), 0);
+        jumps = exp_make_pair(exp_make_fixnum(emit(proto, OP_JUMP_IF_TRUE, 0)),
+                              jumps);
+        adjust(proto, -1);
+      }
+      compile_node(code, CAR(a), tail);
+      depth = before + 1;
+      for (; jumps != NIL; jumps = CDR(jumps)) {
+        patch(proto, FIXNUM_VALUE(CAR(jumps)));
+      }
+      compile_return(proto, tail);
+    }
+    break;
+  case NODE_LAMBDA:
+    {
+      struct exp *captures = node->value.node.d;
+      size_t count = exp_list_length(captures);
+      compile_lambda(node);
+      for (; captures != NIL; captures = CDR(captures)) {
+        compile_node(code, CAR(captures), 0);
+      }
+      emit(proto, OP_CLOSURE, count);
+      emit_word(proto, constant(proto, node));
+      adjust(proto, 1 - (long)count);
+      compile_return(proto, tail);
+    }
+    break;
+  case NODE_BEGIN:
+    for (; CDR(a) != NIL; a = CDR(a)) {
+      compile_node(code, CAR(a), 0);
+      /* boxing a variable leaves nothing on the stack */
+      if (CAR(a)->value.node.type != NODE_BOX) {
+        emit(proto, OP_POP, 0);
+        adjust(proto, -1);
+      }
+    }
+    compile_node(code, CAR(a), tail);
+    break;
+  case NODE_BOX:
+    emit(proto, OP_BOX, node->value.node.slot);
+    break;
+  case NODE_APPLY:
+    compile_apply(code, node, tail);
+    break;
+  default:
+    err_error("compile: bad node type", NULL);
+    break;
+  }
+}
+
+struct exp *compile(struct exp *node) {
+  struct exp *code = proto_new();
+  depth = 0;
+  compile_node(code, node, 1);
+  emit(code->value.proto, OP_RETURN, 0);
+  return code;
+}
@@ -0,0 +1,4 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+extern struct exp *compile(struct exp *node);
+#endif
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,10 +16,53 @@ struct flags config;
 
 struct gc *gc;
 
+/* a size is a number of bytes, or of kilo-, mega- or gigabytes */
+/* with a k, m or g after it */
+static size_t parse_size(const char *arg, const char *str) {
+  char *end;
+  unsigned long long n = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'k': case 'K': n <<= 10; end += 1; break;
+  case 'm': case 'M': n <<= 20; end += 1; break;
+  case 'g': case 'G': n <<= 30; end += 1; break;
+  }
+  if (end == str || *end != '\0') {
+    fprintf(stderr, "bad size in %s\n", arg);
+    exit(1);
+  }
+  return n;
+}
+
+static size_t parse_count(const char *arg, const char *str, size_t max) {
+  char *end;
+  unsigned long n = strtoul(str, &end, 10);
+  if (!isdigit((unsigned char)*str) || *end != '\0' || n < 1 || n > max) {
+    fprintf(stderr, "count must be from 1 to %lu in %s\n",
+            (unsigned long)max, arg);
+    exit(1);
+  }
+  return n;
+}
+
+static double parse_factor(const char *arg, const char *str) {
+  char *end;
+  double x = strtod(str, &end);
+  if (end == str || *end != '\0' || !(x > 1)) {
+    fprintf(stderr, "growth factor must be more than 1 in %s\n", arg);
+    exit(1);
+  }
+  return x;
+}
+
+#define PREFIXED(arg, prefix) (!strncmp(arg, prefix, sizeof prefix - 1))
+
 void config_init(int argc, char **argv) {
   argc -= 1;
   argv += 1;
   file_info.names = malloc(argc * (sizeof *file_info.names));
+  config.heap_initial = 8 << 20;
+  config.heap_growth = 2;
+  gc = &gc_ms;
   while (argc > 0) {
     char *arg = *argv;
     if (!strcmp(arg, "-i")) {
@@ -27,6 +71,40 @@ void config_init(int argc, char **argv) {
       config.debug = ON;
     } else if (!strcmp(arg, "-s")) {
       config.silent = ON;
+    } else if (!strcmp(arg, "--eval=vm")) {
+      config.evaluator = EVAL_VM;
+    } else if (!strcmp(arg, "--eval=tree")) {
+      config.evaluator = EVAL_TREE;
+    } else if (!strcmp(arg, "--jit")) {
+      config.jit = ON;
+    } else if (!strcmp(arg, "-c")) {
+      config.compile = ON;
+    } else if (!strcmp(arg, "-o") && argc > 1) {
+      argc -= 1;
+      argv += 1;
+      config.output = *argv;
+    } else if (!strcmp(arg, "--gc=ms")) {
+      gc = &gc_ms;
+    } else if (!strcmp(arg, "--gc=copy")) {
+      gc = &gc_copy;
+    } else if (!strcmp(arg, "--gc=gen")) {
+      gc = &gc_gen;
+    } else if (!strcmp(arg, "--gc=nop")) {
+      gc = &gc_nop;
+    } else if (PREFIXED(arg, "--heap-initial=")) {
+      config.heap_initial = parse_size(arg, arg + strlen("--heap-initial="));
+    } else if (PREFIXED(arg, "--heap-growth=")) {
+      config.heap_growth = parse_factor(arg, arg + strlen("--heap-growth="));
+    } else if (PREFIXED(arg, "--heap-max=")) {
+      config.heap_max = parse_size(arg, arg + strlen("--heap-max="));
+    } else if (PREFIXED(arg, "--gc-step=")) {
+      config.gc_step = parse_count(arg, arg + strlen("--gc-step="),
+                                   GC_STEP_MAX);
+    } else if (PREFIXED(arg, "--gc-threads=")) {
+      config.gc_threads = parse_count(arg, arg + strlen("--gc-threads="),
+                                      GC_THREADS_MAX);
+    } else if (!strcmp(arg, "--gc-stats")) {
+      config.gc_stats = ON;
     } else {
       file_info.count += 1;
       file_info.names[file_info.count - 1] = arg;
@@ -34,10 +112,13 @@ void config_init(int argc, char **argv) {
     argc -= 1;
     argv += 1;
   }
+  if (gc != &gc_ms && (config.gc_step > 0 || config.gc_threads > 0)) {
+    fprintf(stderr, "--gc-step and --gc-threads work only with --gc=ms\n");
+    exit(1);
+  }
   if (file_info.count == 0) {
     config.interactive = ON;
   }
-  gc = &gc_ms;
 }
 
 #ifndef PREFIX
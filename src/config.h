@@ -8,12 +8,40 @@ enum flag_type {
   ON
 };
 
+enum eval_type {
+  EVAL_VM,
+  EVAL_TREE
+};
+
 struct flags {
+  enum eval_type evaluator;
   enum flag_type debug;
   enum flag_type interactive;
   enum flag_type silent;
+  enum flag_type jit;
+  /* compile to c instead of running, see aot.h */
+  enum flag_type compile;
+  const char *output;
+  /* bytes the heap may grow to before its first collection, how */
+  /* far past what survives a collection it may grow before the */
+  /* next, and the most it may hold at all, 0 for no limit */
+  size_t heap_initial;
+  double heap_growth;
+  size_t heap_max;
+  /* how many objects the collector may mark or sweep at a time, */
+  /* 0 to collect all at once */
+  size_t gc_step;
+  /* how many threads may mark, and a summary of the collections */
+  /* at exit */
+  size_t gc_threads;
+  enum flag_type gc_stats;
 };
 
+/* more would only be waiting on each other */
+#define GC_THREADS_MAX 64
+/* a step this long is as good as a whole collection */
+#define GC_STEP_MAX (1UL << 30)
+
 extern struct flags config;
 
 extern void config_init(int argc, char **argv);
@@ -0,0 +1,115 @@
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "cont.h"
+#include "err.h"
+#include "eval.h"
+#include "exp.h"
+#include "gc.h"
+#include "vm.h"
+
+/* the jumps whose calls are still running, innermost first */
+static struct exp *jumps;
+
+struct exp *cont_new(enum cont_type type) {
+  struct exp *k = (*gc->alloc_exp)(CONTINUATION);
+  k->value.cont = calloc(1, sizeof *k->value.cont);
+  k->value.cont->type = type;
+  return k;
+}
+
+void cont_free(struct cont *k) {
+  free(k->frames);
+  free(k->slots);
+  free(k);
+}
+
+void cont_each(struct cont *k, void (*exp)(struct exp **),
+               void (*env)(struct env **)) {
+  size_t i;
+  for (i = 0; i < k->nframes; i += 1) {
+    struct cont_frame *frame = &k->frames[i];
+    (*exp)(&frame->code);
+    if (frame->captured != NULL) {
+      (*env)(&frame->captured);
+    }
+    if (frame->escape != NULL) {
+      (*exp)(&frame->escape);
+    }
+  }
+  for (i = 0; i < k->nslots; i += 1) {
+    if (k->slots[i] != NULL) {
+      (*exp)(&k->slots[i]);
+    }
+  }
+  if (k->value != NULL) {
+    (*exp)(&k->value);
+  }
+}
+
+/* the vm handles both builtins itself, so these only run outside */
+/* it, where there is no stack to copy and a continuation is an */
+/* escape either way */
+static struct exp *jump(struct exp *proc) {
+  jmp_buf jmp;
+  struct vm_state state;
+  struct eval_state eval_state;
+  struct exp *k = cont_new(CONT_JUMP);
+  struct cont *c = k->value.cont;
+  struct exp *value;
+  c->jmp = &jmp;
+  c->outer = jumps;
+  jumps = k;
+  vm_save(&state);
+  eval_save(&eval_state);
+  if (setjmp(jmp) == 0) {
+    value = eval(exp_make_pair(proc, exp_make_pair(exp_quote(k), NIL)));
+  } else {
+    vm_restore(&state);
+    eval_restore(&eval_state);
+    value = c->value;
+    c->value = NULL;
+  }
+  jumps = c->outer;
+  c->jmp = NULL;
+  return value;
+}
+
+struct exp *cont_call_cc(size_t argc, struct exp **argv) {
+  return jump(argv[0]);
+}
+
+struct exp *cont_call_ec(size_t argc, struct exp **argv) {
+  return jump(argv[0]);
+}
+
+struct exp *cont_throw(struct exp *k, size_t argc, struct exp **argv) {
+  struct exp *live;
+  struct cont *c = k->value.cont;
+  if (argc != 1) {
+    return err_error("continuation: expected one value",
+                     exp_list_from(argc, argv));
+  }
+  if (c->type != CONT_JUMP) {
+    return vm_throw(k, argv[0]);
+  }
+  for (live = jumps; live != NULL && live != k;
+       live = live->value.cont->outer);
+  if (live == NULL) {
+    return err_error("continuation: escape from a call that returned", NULL);
+  }
+  c->value = argv[0];
+  longjmp(*c->jmp, 1);
+}
+
+void cont_reset(void) {
+  jumps = NULL;
+}
+
+void cont_roots(void (*exp)(struct exp **)) {
+  struct exp **k;
+  for (k = &jumps; *k != NULL; k = &(*k)->value.cont->outer) {
+    (*exp)(k);
+  }
+}
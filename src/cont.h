@@ -0,0 +1,64 @@
+#ifndef CONT_H
+#define CONT_H
+#include <setjmp.h>
+#include <stddef.h>
+
+#include "env.h"
+#include "exp.h"
+
+/* continuations come in three kinds. the vm makes the first two */
+/* itself, see vm.c: a copy of its frames and stack from the start */
+/* of the vm_run that made it, which can be returned through any */
+/* number of times, and an escape, which is a mark on one frame and */
+/* good only until that frame returns. the third is what call/cc */
+/* and call/ec make anywhere else, the tree evaluator or compiled */
+/* code: an escape to a setjmp, good only while the call is live. */
+enum cont_type { CONT_COPY, CONT_MARK, CONT_JUMP };
+
+/* a frame of the vm, with stack addresses as offsets */
+struct cont_frame {
+  struct exp *code;
+  size_t pc;
+  size_t locals;                /* CONT_NONE for none */
+  struct env *captured;
+  size_t base;
+  struct exp *escape;
+};
+
+#define CONT_NONE ((size_t)-1)
+
+struct cont {
+  enum cont_type type;
+  /* the vm_run it belongs to, and how many are nested inside */
+  unsigned long run;
+  size_t level;
+  /* the stack slot the value goes to */
+  size_t base;
+  /* where the copied frames and slots go back, or for a mark, */
+  /* how many frames there are up to the marked one */
+  size_t frame;
+  size_t nframes;
+  struct cont_frame *frames;
+  size_t slot;
+  size_t nslots;
+  struct exp **slots;
+  /* a jump, and the one it is nested in */
+  jmp_buf *jmp;
+  struct exp *outer;
+  struct exp *value;
+};
+
+extern struct exp *cont_new(enum cont_type type);
+extern void cont_free(struct cont *k);
+/* visits every reference a continuation holds, for the collectors */
+extern void cont_each(struct cont *k, void (*exp)(struct exp **),
+                      void (*env)(struct env **));
+extern struct exp *cont_call_cc(size_t argc, struct exp **argv);
+extern struct exp *cont_call_ec(size_t argc, struct exp **argv);
+/* passes the one argument to a continuation. never returns. */
+extern struct exp *cont_throw(struct exp *k, size_t argc, struct exp **argv);
+/* forgets the jumps an error unwound past */
+extern void cont_reset(void);
+/* the jumps that are still live */
+extern void cont_roots(void (*exp)(struct exp **));
+#endif
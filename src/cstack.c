@@ -0,0 +1,48 @@
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+
+#include "cstack.h"
+#include "err.h"
+
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+static const size_t wanted = 64 << 20;
+
+static struct {
+  char *base;
+  size_t budget;
+} cstack;
+
+/* called close to the bottom of the stack, from main */
+void cstack_init(void) {
+  char base;
+  size_t size = 8 << 20;
+#ifdef __unix__
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_STACK, &limit) == 0) {
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < wanted &&
+        (limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= wanted)) {
+      /* a limit that could not be raised is still the old one */
+      rlim_t old = limit.rlim_cur;
+      limit.rlim_cur = wanted;
+      if (setrlimit(RLIMIT_STACK, &limit) != 0) {
+        limit.rlim_cur = old;
+      }
+    }
+    size = limit.rlim_cur == RLIM_INFINITY ||
+      limit.rlim_cur > wanted ? wanted : limit.rlim_cur;
+  }
+#endif
+  cstack.base = &base;
+  cstack.budget = size - size / 4;
+}
+
+void cstack_check(const char *msg) {
+  char here;
+  if ((size_t)(cstack.base - &here) > cstack.budget) {
+    err_error(msg, NULL);
+  }
+}
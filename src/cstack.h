@@ -0,0 +1,10 @@
+#ifndef CSTACK_H
+#define CSTACK_H
+/* the evaluators keep their own stacks, but eval called from a */
+/* builtin, and compiled code calling itself, still nest on the c */
+/* stack. they check how much of it is used, and stop well short */
+/* of the limit, which is raised where the system allows. */
+extern void cstack_init(void);
+/* raises msg as an error if the c stack is nearly used up */
+extern void cstack_check(const char *msg);
+#endif
@@ -1,66 +1,122 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "config.h"
 #include "exp.h"
 #include "env.h"
 #include "err.h"
+#include "gc.h"
+#include "symtab.h"
 
-#define FOREACH_ENV(code)                       \
-  do {                                          \
-    { code; }                                   \
-    env = env->parent;                          \
-  } while (env != NULL);
-#define FOREACH_BINDING(code)                   \
-  struct binding *b = env->bindings;            \
-  while (b != NULL) {                           \
-    { code; }                                   \
-    b = b->next;                                \
+/* open addressing with linear probing, hashed by symbol name so */
+/* that a moving collector does not disturb the table */
+static struct {
+  struct exp **cells;
+  size_t capacity;
+  size_t count;
+} globals;
+
+static const size_t globals_min_capacity = 256;
+
+#define CELL_SYMBOL(c) ((c)->value.cell.symbol)
+#define CELL_VALUE(c) ((c)->value.cell.value)
+
+struct env *env_new(size_t size) {
+  return (*gc->alloc_env)(size);
+}
+
+/* sets up the frame for a call to a lambda node. the arguments */
+/* are already in its first slots. any extra ones are collected */
+/* into a list, and the slots for internal defines start empty. */
+/* there must be room for the larger of argc and the frame size. */
+void env_bind(struct exp *lambda, size_t argc, struct exp **slots) {
+  struct exp *params = lambda->value.node.a;
+  size_t size = lambda->value.node.slot;
+  size_t i;
+  for (i = 0; IS(params, PAIR); params = CDR(params), i += 1) {
+    if (i == argc) {
+      err_error("apply: too few args", NULL);
+    }
+  }
+  if (params == NIL) {
+    if (argc > i) {
+      err_error("apply: too many args", NULL);
+    }
+  } else {
+    slots[i] = exp_list_from(argc - i, slots + i);
+    i += 1;
   }
-#define IF_FOUND(code)                                  \
-  if (!strcmp(b->symbol, symbol->value.symbol)) {       \
-    code;                                               \
+  for (; i < size; i += 1) {
+    slots[i] = NULL;
   }
+}
 
-struct exp *env_lookup(struct env *env, struct exp *symbol) {
-  err_ensure(IS(symbol, SYMBOL), "env: expected symbol, got", symbol);
-  FOREACH_ENV({
-      FOREACH_BINDING({
-          IF_FOUND({
-              return b->value;
-            });
-        });
-    });
-  return err_error("env: no binding for symbol", symbol);
+/* a local that is captured and assigned is kept in a box, which */
+/* its frame and every closure that captures it share */
+struct exp *env_box(struct exp *value) {
+  struct exp *box = exp_make_cell(NIL);
+  box->value.cell.value = value;
+  return box;
 }
 
-struct exp *env_update(struct env *env, struct exp *symbol,
-                       struct exp *value) {
-  err_ensure(IS(symbol, SYMBOL), "env: expected symbol, got", symbol);
-  FOREACH_ENV({
-      FOREACH_BINDING({
-          IF_FOUND({
-              b->value = value;
-              return OK;
-            });
-        });
-    });
-  return err_error("env: no binding for symbol", symbol);
+static struct exp **probe(struct exp **cells, size_t capacity,
+                          struct exp *symbol) {
+  size_t i = symtab_hash(symbol->value.symbol) & (capacity - 1);
+  while (cells[i] != NULL && CELL_SYMBOL(cells[i]) != symbol) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &cells[i];
 }
 
-struct exp *env_define(struct env *env, struct exp *symbol,
-                       struct exp *value) {
+static void grow(void) {
+  size_t capacity = globals.capacity > 0 ?
+    globals.capacity * 2 : globals_min_capacity;
+  struct exp **cells = calloc(capacity, sizeof *cells);
+  size_t i;
+  for (i = 0; i < globals.capacity; i += 1) {
+    if (globals.cells[i] != NULL) {
+      *probe(cells, capacity, CELL_SYMBOL(globals.cells[i])) =
+        globals.cells[i];
+    }
+  }
+  free(globals.cells);
+  globals.cells = cells;
+  globals.capacity = capacity;
+}
+
+struct exp *env_cell(struct exp *symbol) {
+  struct exp **cell;
   err_ensure(IS(symbol, SYMBOL), "env: expected symbol, got", symbol);
-  FOREACH_BINDING({
-      IF_FOUND({
-          b->value = value;
-          return OK;
-        });
-    });
-  b = malloc(sizeof *b);
-  b->symbol = malloc(strlen(symbol->value.symbol) + 1);
-  strcpy(b->symbol, symbol->value.symbol);
-  b->value = value;
-  b->next = env->bindings;
-  env->bindings = b;
+  if ((globals.count + 1) * 2 > globals.capacity) {
+    grow();
+  }
+  cell = probe(globals.cells, globals.capacity, symbol);
+  if (*cell == NULL) {
+    *cell = exp_make_cell(symbol);
+    globals.count += 1;
+  }
+  return *cell;
+}
+
+struct exp *env_cell_value(struct exp *cell) {
+  return CELL_VALUE(cell) != NULL ? CELL_VALUE(cell) :
+    err_error("env: no binding for symbol", CELL_SYMBOL(cell));
+}
+
+struct exp *env_define(struct exp *symbol, struct exp *value) {
+  struct exp *cell = env_cell(symbol);
+  ENV_CELL_SET(cell, value);
   return OK;
 }
+
+void env_globals(void (*visit)(struct exp **cell)) {
+  size_t i;
+  for (i = 0; i < globals.capacity; i += 1) {
+    if (globals.cells[i] != NULL) {
+      (*visit)(&globals.cells[i]);
+    }
+  }
+}
+
+#undef CELL_SYMBOL
+#undef CELL_VALUE
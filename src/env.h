@@ -1,19 +1,36 @@
 #ifndef ENV_H
 #define ENV_H
+#include <stddef.h>
+
+#include "gc.h"
+/* a closure holds the values of its free variables. analysis */
+/* gives every variable a slot, so it carries no names. the locals */
+/* of a call are a plain array of slots on an evaluator's stack: */
+/* closures copy what they need, so a frame never outlives its */
+/* call and is never allocated on the heap. */
 struct env {
-  struct binding {
-    char *symbol;
-    struct exp *value;
-    struct binding *next;
-  } *bindings;
-  struct env *parent;
+  size_t size;
+  struct exp *slots[];
 };
 
-extern struct env global_env;
+/* globals live in a hash table of CELL exps keyed by symbol. code */
+/* that refers to a global holds on to its cell, so each variable */
+/* is only looked up once. a cell whose value is NULL is unbound. */
+/* every store goes through ENV_CELL_SET, which drops the guard */
+/* that open-coded builtins depend on. */
+#define ENV_CELL_SET(c, v)                      \
+  do {                                          \
+    GC_WRITE(c);                                \
+    (c)->value.cell.value = (v);                \
+    (c)->value.cell.original = 0;               \
+  } while (0)
 
-extern struct exp *env_define(struct env *env, struct exp *symbol,
-                              struct exp *value);
-extern struct exp *env_lookup(struct env *env, struct exp *symbol);
-extern struct exp *env_update(struct env *env, struct exp *symbol,
-                              struct exp *value);
+extern struct env *env_new(size_t size);
+extern void env_bind(struct exp *lambda, size_t argc, struct exp **slots);
+extern struct exp *env_box(struct exp *value);
+extern struct exp *env_cell(struct exp *symbol);
+extern struct exp *env_cell_value(struct exp *cell);
+extern struct exp *env_define(struct exp *symbol, struct exp *value);
+/* calls visit on every global cell, which may move it */
+extern void env_globals(void (*visit)(struct exp **cell));
 #endif
@@ -2,148 +2,422 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "analyze.h"
+#include "builtin.h"
+#include "compile.h"
 #include "config.h"
+#include "cont.h"
+#include "cstack.h"
 #include "exp.h"
 #include "env.h"
 #include "err.h"
+#include "eval.h"
 #include "gc.h"
+#include "optimize.h"
+#include "runtime.h"
+#include "vm.h"
 
-static int is_self_eval(struct exp *exp);
-static int is_var(struct exp *exp);
-static int is_apply(struct exp *exp);
-static struct exp *map_eval(struct exp *exp, void *data);
-static struct env *extend_env(struct exp *params, struct exp *args,
-                              struct env *parent);
+static struct exp *exec(struct exp *node);
 
-struct exp *eval(struct exp *exp, struct env *env) {
-  for (;;) {
-    if (config.debug) {
-      char *str = exp_stringify(exp);
-      printf("eval: %s\n", str);
-      free(str);
+/* the tree evaluator is an explicit-control machine, as in SICP */
+/* 5.4. rather than call itself to evaluate a subexpression, it */
+/* saves a step saying what to do with the value and goes on to */
+/* the subexpression. frames and arguments go on one stack and */
+/* steps on another, so deep recursion costs memory rather than c */
+/* stack. closures copy what they need, so a frame never outlives */
+/* its call. both stacks grow as needed, and since that can move */
+/* them, they are only ever indexed. */
+enum step_type {
+  STEP_ASSIGN,                  /* store the value, for set! or define */
+  STEP_IF,                      /* choose a branch by the value */
+  STEP_OR,                      /* the value, if true, or go on to rest */
+  STEP_BEGIN,                   /* go on to rest */
+  STEP_OPERAND,                 /* push the value, then evaluate rest */
+  STEP_RETURN                   /* back to the caller's frame */
+};
+
+struct step {
+  enum step_type type;
+  struct exp *node;
+  struct exp *rest;
+  size_t locals;
+  struct env *captured;
+  /* the stack height to go back to */
+  size_t base;
+};
+
+/* the locals of top-level code */
+#define NO_FRAME ((size_t)-1)
+
+static const size_t stack_size = 1 << 14;
+static const size_t stack_max = 1 << 24;
+
+static struct {
+  struct exp **slots;
+  size_t top;
+  size_t size;
+} stack;
+
+static struct {
+  struct step *steps;
+  size_t top;
+  size_t size;
+} control;
+
+/* builtins can call eval, so execs nest. each one records what it */
+/* is running before it calls out or collects. */
+struct machine {
+  struct exp *node;
+  struct env *captured;
+  struct machine *outer;
+};
+
+static struct machine *machines;
+
+void eval_reset(void) {
+  stack.top = 0;
+  control.top = 0;
+  machines = NULL;
+}
+
+void eval_save(struct eval_state *state) {
+  state->stack = stack.top;
+  state->control = control.top;
+  state->machines = machines;
+}
+
+void eval_restore(struct eval_state *state) {
+  stack.top = state->stack;
+  control.top = state->control;
+  machines = state->machines;
+}
+
+void eval_roots(void (*exp)(struct exp **), void (*env)(struct env **)) {
+  struct machine *m;
+  size_t i;
+  for (i = 0; i < stack.top; i += 1) {
+    if (stack.slots[i] != NULL) {
+      (*exp)(&stack.slots[i]);
     }
-    if (is_self_eval(exp)) {
-      return exp;
-    } else if (is_var(exp)) {
-      return env_lookup(env, exp);
-    } else if (exp_list_tagged(exp, "quote")) {
-      return CADR(exp);
-    } else if (exp_list_tagged(exp, "set!")) {
-      return env_update(env, CADR(exp), eval(CADDR(exp), env));
-    } else if (exp_list_tagged(exp, "define")) {
-      struct exp *id = CADR(exp);
-      struct exp *value = eval(CADDR(exp), env);
-      if (IS(value, CLOSURE) && value->value.closure.name == NULL) {
-        value->value.closure.name = malloc(strlen(id->value.symbol) + 1);
-        strcpy(value->value.closure.name, id->value.symbol);
-      }
-      return env_define(env, id, value);
-    } else if (exp_list_tagged(exp, "if")) {
-      if (eval(CADR(exp), env) != FALSE) {
-        exp = CADDR(exp);
-      } else {
-        exp = CADDDR(exp);
-      }
-    } else if (exp_list_tagged(exp, "or")) { /* need to get rid of this */
-      exp = CDR(exp);
-      if (exp == NIL) {
-        return FALSE;
-      } else {
-        while (CDR(exp) != NIL) {
-          struct exp *result = eval(CAR(exp), env);
-          if (result != FALSE) {
-            return result;
-          }
-          exp = CDR(exp);
-        }
-        exp = CAR(exp);
-      }
-    } else if (exp_list_tagged(exp, "lambda")) {
-      return exp_make_closure(CADR(exp), CADDR(exp), env);
-    } else if (exp_list_tagged(exp, "begin")) {
-      exp = CDR(exp);
-      if (exp == NIL) {
-        return OK;
-      } else {
-        while (CDR(exp) != NIL) {
-          eval(CAR(exp), env);
-          exp = CDR(exp);
-        }
-        exp = CAR(exp);
-      }
-    } else if (is_apply(exp)) {
-      struct exp *fn;
-      struct exp *args;
-      exp = exp_list_map(exp, &map_eval, env);
-      fn = CAR(exp);
-      args = CDR(exp);
-      switch (fn->type) {
-      case FUNCTION:
-        return (*fn->value.function.fn)(args);
-      case CLOSURE:
-        env = extend_env(fn->value.closure.params, args,
-                         fn->value.closure.env);
-        exp = fn->value.closure.body;
-        break;
-      default:
-        return err_error("eval: bad function type", exp);
-      }
-    } else {
-      return err_error("eval: unknown exp type", exp);
+  }
+  for (i = 0; i < control.top; i += 1) {
+    struct step *step = &control.steps[i];
+    if (step->node != NULL) {
+      (*exp)(&step->node);
+    }
+    (*exp)(&step->rest);
+    if (step->captured != NULL) {
+      (*env)(&step->captured);
+    }
+  }
+  for (m = machines; m != NULL; m = m->outer) {
+    (*exp)(&m->node);
+    if (m->captured != NULL) {
+      (*env)(&m->captured);
     }
   }
 }
 
-/* the standard requires numbers, strings, characters, */
-/* booleans, and bytevectors to be self-evaluating. */
-/* i do not believe it forbids undefined or procedures */
-/* from also being self-evaluating. */
-/* lists, vectors, and nil are explicitly not self-evaluating. */
-static int is_self_eval(struct exp *exp) {
-  return (IS(exp, UNDEFINED) ||
-          IS(exp, FIXNUM) ||
-          IS(exp, STRING) ||
-          IS(exp, CHARACTER) ||
-          IS(exp, BOOLEAN) ||
-          IS(exp, BYTEVECTOR) ||
-          IS(exp, FUNCTION) ||
-          IS(exp, CLOSURE));
+/* doubles the size of an array until count more items fit past top */
+static void *grow(void *items, size_t item, size_t *size, size_t top,
+                  size_t count) {
+  size_t want = *size > 0 ? *size : stack_size;
+  while (want - top < count) {
+    want *= 2;
+  }
+  if (want > stack_max || (items = realloc(items, want * item)) == NULL) {
+    err_error("eval: stack overflow", NULL);
+  }
+  *size = want;
+  return items;
 }
 
-static int is_var(struct exp *exp) {
-  return IS(exp, SYMBOL);
+/* the index of count new slots on top of the stack */
+static size_t push(size_t count) {
+  size_t at = stack.top;
+  if (stack.size - at < count) {
+    stack.slots = grow(stack.slots, sizeof *stack.slots, &stack.size,
+                       at, count);
+  }
+  stack.top = at + count;
+  return at;
 }
 
-static int is_apply(struct exp *exp) {
-  return IS(exp, PAIR);
+static struct step *save(enum step_type type, struct exp *node,
+                         struct exp *rest, size_t locals,
+                         struct env *captured) {
+  struct step *step;
+  if (control.top == control.size) {
+    control.steps = grow(control.steps, sizeof *control.steps,
+                         &control.size, control.top, 1);
+  }
+  step = &control.steps[control.top];
+  control.top += 1;
+  step->type = type;
+  step->node = node;
+  step->rest = rest;
+  step->locals = locals;
+  step->captured = captured;
+  step->base = stack.top;
+  return step;
 }
 
-static struct exp *map_eval(struct exp *exp, void *data) {
-  struct env *env = data;
-  return eval(exp, env);
+struct exp *eval(struct exp *exp) {
+  struct exp *node;
+  struct exp *code;
+  cstack_check("eval: stack overflow");
+  node = analyze(optimize(exp));
+  switch (config.evaluator) {
+  case EVAL_TREE:
+    return exec(node);
+  case EVAL_VM:
+  default:
+    code = compile(node);
+    if (config.debug) {
+      vm_disassemble(code);
+    }
+    return vm_run(code);
+  }
+}
+
+#define A (node->value.node.a)
+#define B (node->value.node.b)
+#define C (node->value.node.c)
+
+/* locals are the frame of the running procedure and captured */
+/* holds the free variables of its closure. a boxed variable is */
+/* reached through the box in its slot. */
+static struct exp **variable(struct exp *node, struct exp **slots) {
+  struct exp **slot = &slots[node->value.node.slot];
+  return node->value.node.boxed ? &(*slot)->value.cell.value : slot;
+}
+
+/* a store into a box is a store into an exp, see GC_WRITE */
+static void assign(struct exp *node, struct exp **slots, struct exp *value) {
+  if (node->value.node.boxed) {
+    GC_WRITE(slots[node->value.node.slot]);
+  }
+  *variable(node, slots) = value;
 }
 
-static struct env *extend_env(struct exp *params, struct exp *args,
-                              struct env *parent) {
-  struct env *env = (*gc->alloc_env)(parent);
-  for (;;) {
-    if (params == NIL && args == NIL) {
-      return env;
-    } else if (params == NIL) {
-      return err_error("apply: too many args", NULL);
-    } else if (IS(params, PAIR)) {
-      if (args == NIL) {
-        return err_error("apply: too few args", NULL);
+/* the free variables of a new closure are copied from the frame */
+/* and closure it is made in. boxes are copied, not their values. */
+static struct env *capture(struct exp *lambda, struct exp **locals,
+                           struct env *captured) {
+  struct exp *captures = lambda->value.node.d;
+  struct env *values;
+  size_t i;
+  if (captures == NIL) {
+    return NULL;
+  }
+  values = env_new(exp_list_length(captures));
+  for (i = 0; captures != NIL; captures = CDR(captures), i += 1) {
+    struct exp *node = CAR(captures);
+    values->slots[i] = node->value.node.type == NODE_LOCAL ?
+      locals[node->value.node.slot] : captured->slots[node->value.node.slot];
+  }
+  return values;
+}
+
+#define LOCALS (locals != NO_FRAME ? stack.slots + locals : NULL)
+
+static struct exp *exec(struct exp *node) {
+  /* the steps below floor belong to whatever called eval */
+  size_t floor = control.top;
+  size_t locals = NO_FRAME;
+  struct env *captured = NULL;
+  struct exp *value;
+  struct step step;
+  size_t argc;
+  struct exp *fn;
+  struct machine machine;
+  machine.node = node;
+  machine.captured = NULL;
+  machine.outer = machines;
+  machines = &machine;
+
+eval:
+  if (config.debug) {
+    char *str = exp_stringify(analyze_source(node));
+    printf("eval: %s\n", str);
+    free(str);
+  }
+  switch (node->value.node.type) {
+  case NODE_CONST:
+    value = A;
+    goto resume;
+  case NODE_LOCAL:
+  case NODE_FREE:
+    value = *variable(node, node->value.node.type == NODE_LOCAL ?
+                      LOCALS : captured->slots);
+    if (value == NULL) {
+      err_error("eval: variable used before its definition", A);
+    }
+    goto resume;
+  case NODE_GLOBAL:
+    value = env_cell_value(C);
+    goto resume;
+  case NODE_SET_LOCAL:
+  case NODE_SET_FREE:
+  case NODE_SET_GLOBAL:
+  case NODE_DEFINE_LOCAL:
+  case NODE_DEFINE_GLOBAL:
+    save(STEP_ASSIGN, node, NIL, locals, captured);
+    node = B;
+    goto eval;
+  case NODE_IF:
+    save(STEP_IF, node, NIL, locals, captured);
+    node = A;
+    goto eval;
+  case NODE_OR:
+  case NODE_BEGIN:
+    if (CDR(A) != NIL) {
+      save(node->value.node.type == NODE_OR ? STEP_OR : STEP_BEGIN,
+           node, CDR(A), locals, captured);
+    }
+    node = CAR(A);
+    goto eval;
+  case NODE_LAMBDA:
+    value = exp_make_closure(node, capture(node, LOCALS, captured));
+    goto resume;
+  case NODE_APPLY:
+    save(STEP_OPERAND, node, B, locals, captured);
+    node = A;
+    goto eval;
+  case NODE_BOX:
+    {
+      struct exp **slot = &LOCALS[node->value.node.slot];
+      *slot = env_box(*slot);
+      value = OK;
+      goto resume;
+    }
+  default:
+    return err_error("eval: bad node type", NULL);
+  }
+
+  /* hands the value to the last step saved */
+resume:
+  if (control.top == floor) {
+    machines = machine.outer;
+    return value;
+  }
+  control.top -= 1;
+  step = control.steps[control.top];
+  node = step.node;
+  locals = step.locals;
+  captured = step.captured;
+  switch (step.type) {
+  case STEP_ASSIGN:
+    switch (node->value.node.type) {
+    case NODE_SET_LOCAL:
+    case NODE_SET_FREE:
+      assign(node, node->value.node.type == NODE_SET_LOCAL ?
+             LOCALS : captured->slots, value);
+      break;
+    case NODE_SET_GLOBAL:
+      env_cell_value(C);
+      ENV_CELL_SET(C, value);
+      break;
+    case NODE_DEFINE_LOCAL:
+      exp_name(value, A);
+      assign(node, LOCALS, value);
+      break;
+    default:
+      exp_name(value, A);
+      ENV_CELL_SET(C, value);
+      break;
+    }
+    value = OK;
+    goto resume;
+  case STEP_IF:
+    node = value != FALSE ? B : C;
+    goto eval;
+  case STEP_OR:
+    if (value != FALSE) {
+      goto resume;
+    }
+    /* fall through */
+  case STEP_BEGIN:
+    if (CDR(step.rest) != NIL) {
+      save(step.type, node, CDR(step.rest), locals, captured);
+    }
+    node = CAR(step.rest);
+    goto eval;
+  case STEP_OPERAND:
+    {
+      size_t at = push(1);
+      stack.slots[at] = value;
+    }
+    if (step.rest != NIL) {
+      save(STEP_OPERAND, node, CDR(step.rest), locals, captured)->base =
+        step.base;
+      node = CAR(step.rest);
+      goto eval;
+    }
+    goto apply;
+  case STEP_RETURN:
+    stack.top = step.base;
+    goto resume;
+  }
+
+  /* the operator and arguments are on the stack from step.base */
+apply:
+  fn = stack.slots[step.base];
+  argc = stack.top - step.base - 1;
+  machine.node = node;
+  machine.captured = captured;
+  switch (TYPE(fn)) {
+  case FUNCTION:
+    value = builtin_apply(fn, argc, stack.slots + step.base + 1);
+    break;
+  case CLOSURE:
+    if (fn->value.closure.native != NULL) {
+      /* compiled to c ahead of time */
+      value = runtime_apply(fn, argc, stack.slots + step.base + 1);
+      break;
+    }
+    {
+      struct exp *lambda = fn->value.closure.lambda;
+      size_t slots = lambda->value.node.slot;
+      size_t frame;
+      if (control.top > floor &&
+          control.steps[control.top - 1].type == STEP_RETURN) {
+        /* a call in tail position replaces the frame of the last */
+        /* one, whose locals are no longer needed */
+        frame = locals;
+      } else {
+        save(STEP_RETURN, NULL, NIL, locals, captured)->base = step.base;
+        frame = step.base;
       }
-      /* FIX non-symbol params should be an error */
-      if (IS(CAR(params), SYMBOL)) {
-        env_define(env, CAR(params), CAR(args));
+      memmove(stack.slots + frame, stack.slots + step.base + 1,
+              argc * sizeof *stack.slots);
+      stack.top = frame;
+      push(argc > slots ? argc : slots);
+      env_bind(lambda, argc, stack.slots + frame);
+      locals = frame;
+      captured = fn->value.closure.env;
+      node = lambda->value.node.b;
+      if (gc_wanted) {
+        machine.node = node;
+        machine.captured = captured;
+        GC_SAFEPOINT();
+        /* in case the collector moved them */
+        node = machine.node;
+        captured = machine.captured;
       }
-      params = CDR(params);
-      args = CDR(args);
-    } else if (IS(params, SYMBOL)) {
-      env_define(env, params, args);
-      return env;
+      goto eval;
     }
+  case CONTINUATION:
+    return cont_throw(fn, argc, stack.slots + step.base + 1);
+  default:
+    return err_error("eval: bad function type",
+                     exp_list_from(argc + 1, stack.slots + step.base));
   }
+  stack.top = step.base;
+  goto resume;
 }
+
+#undef A
+#undef B
+#undef C
+#undef LOCALS
@@ -1,5 +1,22 @@
 #ifndef EVAL_H
 #define EVAL_H
+#include <stddef.h>
+
+extern struct exp *eval(struct exp *exp);
+extern void eval_reset(void);
+
+/* where the tree evaluator was, to go back to after a longjmp */
+/* past it */
+struct eval_state {
+  size_t stack;
+  size_t control;
+  struct machine *machines;
+};
+
+extern void eval_save(struct eval_state *state);
+extern void eval_restore(struct eval_state *state);
 struct env;
-extern struct exp *eval(struct exp *exp, struct env *env);
+/* the stacks of the tree evaluator, and what each exec is running */
+extern void eval_roots(void (*exp)(struct exp **),
+                       void (*env)(struct env **));
 #endif
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,14 +10,10 @@
 #include "exp.h"
 #include "err.h"
 #include "gc.h"
+#include "symtab.h"
 #include "util/strbuf.h"
 #include "util/vector.h"
 
-struct exp nil = { .type = NIL_TYPE };
-struct exp ok = { .type = UNDEFINED };
-struct exp true = { .type = BOOLEAN };
-struct exp false = { .type = BOOLEAN };
-
 struct exp *exp_make_atom(const char *str) {
   if (!strcmp(str, "#t")) {
     return TRUE;
@@ -38,8 +35,15 @@ struct exp *exp_make_atom(const char *str) {
     case SYMBOL:
       return exp_make_symbol(str);
     case FIXNUM:
-      /* not handling overflow */
-      return exp_make_fixnum(strtol(str, NULL, 10));
+      {
+        long fixnum;
+        errno = 0;
+        fixnum = strtol(str, NULL, 10);
+        if (errno == ERANGE || fixnum > FIXNUM_MAX || fixnum < FIXNUM_MIN) {
+          return NULL;
+        }
+        return exp_make_fixnum(fixnum);
+      }
     default:
       return err_error("unexpected atom type", NULL);
     }
@@ -47,10 +51,7 @@ struct exp *exp_make_atom(const char *str) {
 }
 
 struct exp *exp_make_symbol(const char *sym) {
-  struct exp *symbol = (*gc->alloc_exp)(SYMBOL);
-  symbol->value.symbol = malloc(strlen(sym) + 1);
-  strcpy(symbol->value.symbol, sym);
-  return symbol;
+  return symtab_intern(sym);
 }
 
 struct exp *exp_make_list(struct exp *first, ...) {
@@ -107,9 +108,7 @@ struct exp *exp_make_string(char *str) {
 }
 
 struct exp *exp_make_character(int c) {
-  struct exp *character = (*gc->alloc_exp)(CHARACTER);
-  character->value.character = c;
-  return character;
+  return EXP_IMMEDIATE(CHARACTER, (unsigned char)c);
 }
 
 struct exp *exp_make_pair(struct exp *first, struct exp *rest) {
@@ -120,34 +119,61 @@ struct exp *exp_make_pair(struct exp *first, struct exp *rest) {
 }
 
 struct exp *exp_make_fixnum(long fixnum) {
-  struct exp *e = (*gc->alloc_exp)(FIXNUM);
-  e->value.fixnum = fixnum;
-  return e;
+  return (struct exp *)(((uintptr_t)fixnum << 1) | EXP_FIXNUM_TAG);
 }
 
-struct exp *exp_make_closure(struct exp *params, struct exp *body,
-                             struct env *env) {
+struct exp *exp_make_closure(struct exp *lambda, struct env *env) {
   struct exp *e = (*gc->alloc_exp)(CLOSURE);
-  e->value.closure.params = params;
-  e->value.closure.body = body;
+  e->value.closure.lambda = lambda;
   e->value.closure.env = env;
+  e->value.closure.native = NULL;
+  return e;
+}
+
+/* anonymous closures take the name of the variable they are */
+/* first defined as, which makes them easier to recognize */
+void exp_name(struct exp *exp, struct exp *symbol) {
+  if (IS(exp, CLOSURE) && exp->value.closure.name == NULL) {
+    exp->value.closure.name = malloc(strlen(symbol->value.symbol) + 1);
+    strcpy(exp->value.closure.name, symbol->value.symbol);
+  }
+}
+
+struct exp *exp_make_cell(struct exp *symbol) {
+  struct exp *e = (*gc->alloc_exp)(CELL);
+  e->value.cell.symbol = symbol;
+  e->value.cell.value = NULL;
+  e->value.cell.original = 0;
+  return e;
+}
+
+struct exp *exp_make_node(enum node_type type, struct exp *a,
+                          struct exp *b, struct exp *c) {
+  struct exp *e = (*gc->alloc_exp)(NODE);
+  e->value.node.type = type;
+  e->value.node.boxed = 0;
+  e->value.node.slot = 0;
+  e->value.node.a = a;
+  e->value.node.b = b;
+  e->value.node.c = c;
+  e->value.node.d = NIL;
   return e;
 }
 
 struct exp *exp_copy(struct exp *exp) {
   assert(exp != NULL);
-  switch (exp->type) {
+  switch (TYPE(exp)) {
   case UNDEFINED:
   case BOOLEAN:
   case NIL_TYPE:
+  case FIXNUM:
+  case CHARACTER:
     return exp;
   case PAIR:
     return exp_make_pair(exp_copy(exp->value.pair.first),
                          exp_copy(exp->value.pair.rest));
-  case FIXNUM:
-    return exp_make_fixnum(exp->value.fixnum);
   case SYMBOL:
-    return exp_make_symbol(exp->value.symbol);
+    return exp;
   case STRING:
     return exp_make_string(exp->value.string);
   default:
@@ -155,10 +181,6 @@ struct exp *exp_copy(struct exp *exp) {
   }
 }
 
-int exp_symbol_eq(struct exp *exp, const char *s) {
-  return IS(exp, SYMBOL) && !strcmp(exp->value.symbol, s);
-}
-
 struct char_name {
   const char *name;
   int value;
@@ -199,7 +221,7 @@ const char *exp_char_to_name(int c) {
 }
 
 struct exp *exp_quote(struct exp *exp) {
-  return exp_make_list(exp_make_symbol("quote"),
+  return exp_make_list(KEYWORD(QUOTE),
                        exp,
                        NULL);
 }
@@ -215,8 +237,17 @@ size_t exp_list_length(struct exp *list) {
   return len;
 }
 
-int exp_list_tagged(struct exp *list, const char *symbol) {
-  return IS(list, PAIR) && exp_symbol_eq(CAR(list), symbol);
+struct exp *exp_list_from(size_t n, struct exp **items) {
+  struct exp *list = NIL;
+  while (n > 0) {
+    n -= 1;
+    list = exp_make_pair(items[n], list);
+  }
+  return list;
+}
+
+int exp_list_tagged(struct exp *list, struct exp *symbol) {
+  return IS(list, PAIR) && CAR(list) == symbol;
 }
 
 int exp_list_proper(struct exp *list) {
@@ -246,29 +277,33 @@ struct exp *exp_list_map(struct exp *list,
                          struct exp *(*fn)(struct exp *list,
                                            void *data),
                          void *data) {
-  if (list == NIL) {
-    return NIL;
-  } else {
-    struct exp *first = (*fn)(CAR(list), data);
-    struct exp *rest = exp_list_map(CDR(list), fn, data);
-    return exp_make_pair(first, rest);
+  /* built front to back, so a long list does not use up the c stack */
+  struct exp *head = NIL;
+  struct exp **tail = &head;
+  for (; list != NIL; list = CDR(list)) {
+    *tail = exp_make_pair((*fn)(CAR(list), data), NIL);
+    tail = &(*tail)->value.pair.rest;
   }
+  return head;
 }
 
 struct exp *exp_nth(struct exp *list, size_t n) {
-  return n == 0 ? CAR(list) : exp_nth(CDR(list), n - 1);
+  for (; n > 0; n -= 1) {
+    list = CDR(list);
+  }
+  return CAR(list);
 }
 
 struct tag_syntax {
-  const char *tag;
+  enum keyword tag;
   const char *syntax;
 };
 
 static struct tag_syntax tag_map[] = {
-  { .tag = "quote", .syntax = "'" },
-  { .tag = "quasiquote", .syntax = "`" },
-  { .tag = "unquote", .syntax = "," },
-  { .tag = "unquote-splicing", .syntax = ",@" }
+  { .tag = KEYWORD_QUOTE, .syntax = "'" },
+  { .tag = KEYWORD_QUASIQUOTE, .syntax = "`" },
+  { .tag = KEYWORD_UNQUOTE, .syntax = "," },
+  { .tag = KEYWORD_UNQUOTE_SPLICING, .syntax = ",@" }
 };
 
 #define CAT(s)                                  \
@@ -286,7 +321,7 @@ static struct tag_syntax tag_map[] = {
 char *exp_stringify(struct exp *exp) {
   char *str;
   size_t len;
-  switch (exp->type) {
+  switch (TYPE(exp)) {
   case SYMBOL:
     str = malloc(strlen(exp->value.symbol) + 1);
     strcpy(str, exp->value.symbol);
@@ -319,36 +354,36 @@ char *exp_stringify(struct exp *exp) {
       return str;
     }
   case CHARACTER:
-    if (isgraph(exp->value.character)) {
+    if (isgraph(CHARACTER_VALUE(exp))) {
       str = malloc(4);
-      sprintf(str, "#\\%c", exp->value.character);
+      sprintf(str, "#\\%c", CHARACTER_VALUE(exp));
       return str;
     } else {
-      const char *name = exp_char_to_name(exp->value.character);
+      const char *name = exp_char_to_name(CHARACTER_VALUE(exp));
       if (name != NULL) {
         str = malloc(strlen(name) + 3);
         sprintf(str, "#\\%s", name);
         return str;
       } else {
         str = malloc(6);
-        sprintf(str, "#\\x%02x", exp->value.character);
+        sprintf(str, "#\\x%02x", CHARACTER_VALUE(exp));
         return str;
       }
     }
   case FIXNUM:
     len = 0;
     {
-      long n = exp->value.fixnum;
+      long n = FIXNUM_VALUE(exp);
       if (n < 0) {
         len += 1;
       }
-      while (n != 0) {
+      do {
         len += 1;
         n /= 10;
-      }
+      } while (n != 0);
     }
     str = malloc(len + 1);
-    sprintf(str, "%ld", exp->value.fixnum);
+    sprintf(str, "%ld", FIXNUM_VALUE(exp));
     return str;
   case BOOLEAN:
     str = malloc(3);
@@ -373,7 +408,7 @@ char *exp_stringify(struct exp *exp) {
       size_t i;
       for (i = 0; i < NELEM(tag_map); i += 1) {
         struct tag_syntax *mapping = &tag_map[i];
-        if (exp_symbol_eq(CAR(exp), mapping->tag)) {
+        if (CAR(exp) == keywords[mapping->tag]) {
           size_t cap = strlen(mapping->syntax);
           str = malloc(cap);
           len = 0;
@@ -463,12 +498,16 @@ char *exp_stringify(struct exp *exp) {
       strcpy(str, "#<procedure>");
     }
     return str;
+  case CONTINUATION:
+    str = malloc(16);
+    strcpy(str, "#<continuation>");
+    return str;
   case UNDEFINED:
     str = malloc(13);
     strcpy(str, "#<undefined>");
     return str;
   default:
-    printf("exp type %d\n", exp->type);
+    printf("exp type %d\n", TYPE(exp));
     return err_error("exp_stringify: bad exp type", NULL);
   }
 }
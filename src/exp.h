@@ -1,5 +1,6 @@
 #ifndef EXP_H
 #define EXP_H
+#include <stdint.h>
 enum exp_type {
   UNDEFINED,
   PAIR,
@@ -13,9 +14,33 @@ enum exp_type {
   PORT,                         /* needs input/output and textual/binary */
   CLOSURE,
   FUNCTION,
+  NODE,                         /* analyzed code, see analyze.h */
+  PROTO,                        /* compiled code, see vm.h */
+  CELL,                         /* a variable, see env.h */
+  CONTINUATION,                 /* see cont.h */
   NIL_TYPE
 };
 
+enum node_type {
+  NODE_CONST,
+  NODE_LOCAL,
+  NODE_FREE,
+  NODE_GLOBAL,
+  NODE_SET_LOCAL,
+  NODE_SET_FREE,
+  NODE_SET_GLOBAL,
+  NODE_DEFINE_LOCAL,
+  NODE_DEFINE_GLOBAL,
+  NODE_IF,
+  NODE_OR,
+  NODE_LAMBDA,
+  NODE_BEGIN,
+  NODE_APPLY,
+  NODE_BOX
+};
+
+#define FUNCTION_TYPES_MAX 3
+
 struct exp {
   enum exp_type type;
   union {
@@ -23,10 +48,8 @@ struct exp {
       struct exp *first;
       struct exp *rest;
     } pair;
-    long fixnum;
     char *symbol;
     char *string;
-    char character;
     struct vector *bytevector;
     struct vector *vector;
     struct {
@@ -34,32 +57,84 @@ struct exp {
     } port;
     struct {
       char *name;
-      struct exp *params;
-      struct exp *body;
+      struct exp *lambda;
+      /* the values of the lambda's free variables, or NULL */
       struct env *env;
+      /* the body compiled to c ahead of time, see runtime.h */
+      struct exp *(*native)(struct exp **locals, struct env *captured);
     } closure;
     struct {
       char *name;
-      struct exp *(*fn)(struct exp *args);
+      struct exp *(*fn)(size_t argc, struct exp **argv);
+      /* the signature, see builtin.h */
+      unsigned char min_args;
+      unsigned char max_args;
+      unsigned char types[FUNCTION_TYPES_MAX];
     } function;
+    struct {
+      enum node_type type;
+      /* whether a variable lives in a box, see analyze.c */
+      unsigned short boxed;
+      /* the index of a variable in its frame or closure, the */
+      /* argument count of an application, or for a lambda, */
+      /* how many slots its frames need */
+      unsigned short slot;
+      struct exp *a;
+      struct exp *b;
+      struct exp *c;
+      /* for a lambda, the nodes that load its free variables */
+      struct exp *d;
+    } node;
+    struct proto *proto;
+    struct cont *cont;
+    /* a global variable, or the box of a local that is both */
+    /* captured and assigned */
+    struct {
+      struct exp *symbol;
+      struct exp *value;
+      /* set while the cell still holds the builtin installed */
+      /* at startup, which lets compiled code open-code it */
+      int original;
+    } cell;
   } value;
 };
 
-extern struct exp nil;
-#define NIL (&nil)
-
-extern struct exp ok;
-#define OK (&ok)
-
-extern struct exp true;
-#define TRUE (&true)
+/* fixnums, characters, booleans, nil and the undefined value */
+/* live in the pointer word itself and are never allocated. heap */
+/* exps are at least 8-byte aligned, so a real pointer always has */
+/* its low bits clear. the encodings are: */
+/*   ...1  fixnum, with the value in the remaining bits */
+/*   ..10  other immediate, with its type in bits 2-7 and */
+/*         its value from bit 8 up */
+#define EXP_FIXNUM_TAG 0x1
+#define EXP_IMMEDIATE_TAG 0x2
+#define EXP_WORD(exp) ((uintptr_t)(exp))
+#define EXP_IS_FIXNUM(exp) ((EXP_WORD(exp) & 0x1) != 0)
+#define EXP_IS_IMMEDIATE(exp) ((EXP_WORD(exp) & 0x3) != 0)
+#define EXP_IMMEDIATE(type, value)                                      \
+  ((struct exp *)(((uintptr_t)(value) << 8) |                           \
+                  ((uintptr_t)(type) << 2) |                            \
+                  EXP_IMMEDIATE_TAG))
 
-extern struct exp false;
-#define FALSE (&false)
+#define NIL EXP_IMMEDIATE(NIL_TYPE, 0)
+#define OK EXP_IMMEDIATE(UNDEFINED, 0)
+#define TRUE EXP_IMMEDIATE(BOOLEAN, 1)
+#define FALSE EXP_IMMEDIATE(BOOLEAN, 0)
 
-/* maybe there should be globals for keywords */
+/* keywords are globals, see symtab.h */
 
-#define IS(exp, t) ((exp)->type == (t))
+#define TYPE(exp)                                                       \
+  (EXP_IS_FIXNUM(exp) ? FIXNUM :                                        \
+   EXP_IS_IMMEDIATE(exp) ? (enum exp_type)((EXP_WORD(exp) >> 2) & 0x3f) : \
+   (exp)->type)
+#define IS(exp, t) (TYPE(exp) == (t))
+/* relies on >> of a negative number being arithmetic */
+#define FIXNUM_VALUE(exp) ((long)((intptr_t)(exp) >> 1))
+/* the range a fixnum can hold, a bit short of a long */
+#define FIXNUM_MAX ((long)(INTPTR_MAX >> 1))
+#define FIXNUM_MIN (-FIXNUM_MAX - 1)
+#define CHARACTER_VALUE(exp) ((int)(EXP_WORD(exp) >> 8))
+/* NULL for a number too big for a fixnum */
 extern struct exp *exp_make_atom(const char *str);
 extern struct exp *exp_make_symbol(const char *sym);
 extern struct exp *exp_make_list(struct exp *first, ...);
@@ -70,15 +145,18 @@ extern struct exp *exp_make_character(int c);
 extern struct exp *exp_make_pair(struct exp *first, struct exp *rest);
 extern struct exp *exp_make_fixnum(long fixnum);
 struct env;
-extern struct exp *exp_make_closure(struct exp *params, struct exp *body,
-                                    struct env *env);
+extern struct exp *exp_make_closure(struct exp *lambda, struct env *env);
+extern void exp_name(struct exp *exp, struct exp *symbol);
+extern struct exp *exp_make_cell(struct exp *symbol);
+extern struct exp *exp_make_node(enum node_type type, struct exp *a,
+                                 struct exp *b, struct exp *c);
 extern struct exp *exp_copy(struct exp *exp);
-extern int exp_symbol_eq(struct exp *exp, const char *s);
 extern int exp_name_to_char(const char *name);
 extern const char *exp_char_to_name(int c);
 extern struct exp *exp_quote(struct exp *exp);
 extern size_t exp_list_length(struct exp *list);
-extern int exp_list_tagged(struct exp *list, const char *symbol);
+extern struct exp *exp_list_from(size_t n, struct exp **items);
+extern int exp_list_tagged(struct exp *list, struct exp *symbol);
 extern int exp_list_proper(struct exp *list);
 extern struct exp *exp_list_map(struct exp *list,
                                 struct exp *(*fn)(struct exp *list,
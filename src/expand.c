@@ -3,6 +3,7 @@
 
 #include "err.h"
 #include "exp.h"
+#include "symtab.h"
 
 static struct exp *expand_quote(struct exp *exp);
 static struct exp *expand_set(struct exp *exp);
@@ -17,21 +18,21 @@ static struct exp *expand_quasiquote(struct exp *exp);
 static struct exp *map_expand(struct exp *exp, void *data);
 
 struct tag_expand {
-  const char *tag;
+  enum keyword tag;
   struct exp *(*expand)(struct exp *exp);
 };
 
 static struct tag_expand tag_map[] = {
-  { .tag = "quote", .expand = &expand_quote },
-  { .tag = "set!", .expand = &expand_set },
-  { .tag = "define", .expand = &expand_define },
-  { .tag = "if", .expand = &expand_if },
-  { .tag = "lambda", .expand = &expand_lambda },
-  { .tag = "begin", .expand = &expand_begin },
-  { .tag = "cond", .expand = &expand_cond },
-  { .tag = "and", .expand = &expand_and },
-  { .tag = "or", .expand = &expand_or },
-  { .tag = "quasiquote", .expand = &expand_quasiquote }
+  { .tag = KEYWORD_QUOTE, .expand = &expand_quote },
+  { .tag = KEYWORD_SET, .expand = &expand_set },
+  { .tag = KEYWORD_DEFINE, .expand = &expand_define },
+  { .tag = KEYWORD_IF, .expand = &expand_if },
+  { .tag = KEYWORD_LAMBDA, .expand = &expand_lambda },
+  { .tag = KEYWORD_BEGIN, .expand = &expand_begin },
+  { .tag = KEYWORD_COND, .expand = &expand_cond },
+  { .tag = KEYWORD_AND, .expand = &expand_and },
+  { .tag = KEYWORD_OR, .expand = &expand_or },
+  { .tag = KEYWORD_QUASIQUOTE, .expand = &expand_quasiquote }
 };
 
 #define NELEM(arr) ((sizeof arr) / (sizeof arr[0]))
@@ -43,7 +44,7 @@ struct exp *expand(struct exp *exp) {
   }
   size_t i;
   for (i = 0; i < NELEM(tag_map); i += 1) {
-    if (exp_list_tagged(exp, tag_map[i].tag)) {
+    if (exp_list_tagged(exp, keywords[tag_map[i].tag])) {
       return (*tag_map[i].expand)(exp);
     }
   }
@@ -71,7 +72,7 @@ static struct exp *expand_define(struct exp *exp) {
   size_t length = exp_list_length(exp);
   err_ensure(length >= 3, "expand: bad syntax in define", exp);
   struct exp *id = CADR(exp);
-  switch (id->type) {
+  switch (TYPE(id)) {
   case SYMBOL:
     err_ensure(length == 3, "expand: bad syntax in define", exp);
     return exp_make_list(CAR(exp),
@@ -96,7 +97,7 @@ static struct exp *expand_define(struct exp *exp) {
       id = CAR(id);
       return exp_make_list(CAR(exp),
                            id,
-                           expand(exp_make_pair(exp_make_symbol("lambda"),
+                           expand(exp_make_pair(KEYWORD(LAMBDA),
                                                 exp_make_pair(args,
                                                               CDDR(exp)))),
                            NULL);
@@ -126,7 +127,7 @@ static struct exp *expand_lambda(struct exp *exp) {
   size_t length = exp_list_length(exp);
   err_ensure(length >= 3, "expand: bad syntax in lambda", exp);
   struct exp *params = CADR(exp);
-  switch (params->type) {
+  switch (TYPE(params)) {
   case PAIR:
     {
       /* FIX need to check param symbols for uniqueness */
@@ -153,7 +154,7 @@ static struct exp *expand_lambda(struct exp *exp) {
   struct exp *body =
     (length == 3 ?
      exp_make_pair(expand(CADDR(exp)), NIL) :
-     exp_make_pair(expand(exp_make_pair(exp_make_symbol("begin"),
+     exp_make_pair(expand(exp_make_pair(KEYWORD(BEGIN),
                                         CDDR(exp))), NIL));
   return exp_make_pair(CAR(exp),
                        exp_make_pair(params, body));
@@ -177,8 +178,8 @@ static struct exp *expand_cond_clauses(struct exp *exp) {
     err_ensure(exp_list_length(clause) == 2,
                "expand: bad syntax in cond", exp);
     struct exp *pred = CAR(clause);
-    return exp_make_list(exp_make_atom("if"),
-                         exp_symbol_eq(pred, "else") ? TRUE : expand(pred),
+    return exp_make_list(KEYWORD(IF),
+                         pred == KEYWORD(ELSE) ? TRUE : expand(pred),
                          expand(CADR(clause)),
                          expand_cond_clauses(CDR(exp)),
                          NULL);
@@ -197,7 +198,7 @@ static struct exp *expand_and_tests(struct exp *exp) {
   case 1:
     return CAR(exp);
   default:
-    return exp_make_list(exp_make_symbol("if"),
+    return exp_make_list(KEYWORD(IF),
                          CAR(exp),
                          expand_and_tests(CDR(exp)),
                          FALSE,
@@ -218,7 +219,7 @@ static struct exp *expand_or_tests(struct exp *exp) {
   case 1:
     return CAR(exp);
   default:
-    return exp_make_pair(exp_make_symbol("or"),
+    return exp_make_pair(KEYWORD(OR),
                          exp);
   }
 }
@@ -237,9 +238,10 @@ static struct exp *expand_qq_template(struct exp *exp, size_t nesting) {
   if (!IS(exp, PAIR)) {
     return exp;
   }
-  err_ensure(!(exp_list_tagged(exp, "unquote-splicing") && nesting == 0),
+  err_ensure(!(exp_list_tagged(exp, KEYWORD(UNQUOTE_SPLICING)) &&
+               nesting == 0),
              "expand: bad syntax in quasiquote", exp);
-  if (exp_list_tagged(exp, "quasiquote")) {
+  if (exp_list_tagged(exp, KEYWORD(QUASIQUOTE))) {
     err_ensure(exp_list_length(exp) == 2,
                "expand: bad syntax in quasiquote", exp);
     struct exp *expanded = expand_qq_template(CADR(exp), nesting + 1);
@@ -248,11 +250,11 @@ static struct exp *expand_qq_template(struct exp *exp, size_t nesting) {
       return exp;
     } else {
       return exp_make_list(exp_make_symbol("list"),
-                           exp_quote(exp_make_symbol("quasiquote")),
+                           exp_quote(KEYWORD(QUASIQUOTE)),
                            expanded,
                            NULL);
     }
-  } else if (exp_list_tagged(exp, "unquote")) {
+  } else if (exp_list_tagged(exp, KEYWORD(UNQUOTE))) {
     err_ensure(exp_list_length(exp) == 2,
                "expand: bad syntax in quasiquote", exp);
     if (nesting == 0) {
@@ -262,11 +264,11 @@ static struct exp *expand_qq_template(struct exp *exp, size_t nesting) {
       return expanded == CADR(exp) ?
         exp :
         exp_make_list(exp_make_symbol("list"),
-                      exp_quote(exp_make_symbol("unquote")),
+                      exp_quote(KEYWORD(UNQUOTE)),
                       expanded,
                       NULL);
     }
-  } else if (exp_list_tagged(CAR(exp), "unquote-splicing")) {
+  } else if (exp_list_tagged(CAR(exp), KEYWORD(UNQUOTE_SPLICING))) {
     struct exp *rest = expand_qq_template(CDR(exp), nesting);
     if (nesting == 0) {
       return exp_make_list(exp_make_symbol("append"),
@@ -282,7 +284,7 @@ static struct exp *expand_qq_template(struct exp *exp, size_t nesting) {
                       (expanded == CADR(CAR(exp)) ?
                        exp_quote(CAR(exp)) :
                        exp_make_list(exp_make_symbol("list"),
-                                     exp_quote(exp_make_symbol("unquote-splicing")),
+                                     exp_quote(KEYWORD(UNQUOTE_SPLICING)),
                                      expanded,
                                      NULL)),
                       (rest == CDR(exp) ?
@@ -0,0 +1,70 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <time.h>
+
+#include "cont.h"
+#include "eval.h"
+#include "gc.h"
+#include "vm.h"
+
+int gc_wanted;
+int gc_safepoints = 1;
+
+static struct {
+  unsigned long count;
+  double total;
+  double max;
+} pauses;
+
+void gc_roots(void (*exp)(struct exp **), void (*env)(struct env **)) {
+  vm_roots(exp, env);
+  eval_roots(exp, env);
+  cont_roots(exp);
+}
+
+double gc_clock(void) {
+#ifdef __unix__
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* only a pause in which the collector did some work counts */
+void gc_pause(void) {
+  double start = gc_clock();
+  double pause;
+  if (!(*gc->collect)()) {
+    return;
+  }
+  pause = gc_clock() - start;
+  pauses.count += 1;
+  pauses.total += pause;
+  if (pause > pauses.max) {
+    pauses.max = pause;
+  }
+}
+
+void gc_stats(struct gc_stats *stats) {
+  (*gc->stats)(stats);
+  stats->pauses = pauses.count;
+  stats->pause_total = pauses.total;
+  stats->pause_max = pauses.max;
+}
+
+void gc_report(void) {
+  struct gc_stats stats;
+  gc_stats(&stats);
+  fprintf(stderr, "gc: %lu collections in %lu pauses, %.1fms in all "
+          "and %.1fms at the longest\n", stats.collections, stats.pauses,
+          stats.pause_total * 1e3, stats.pause_max * 1e3);
+  fprintf(stderr, "gc: %lu bytes allocated in %lu objects, %lu bytes "
+          "in %lu live after the last collection\n",
+          (unsigned long)stats.bytes_allocated,
+          (unsigned long)stats.objects_allocated,
+          (unsigned long)stats.live_bytes,
+          (unsigned long)stats.live_objects);
+}
@@ -1,13 +1,77 @@
 #ifndef GC_H
 #define GC_H
+#include "config.h"
 #include "exp.h"
+struct env;
+
+/* what a collector has done since the program started */
+struct gc_stats {
+  unsigned long collections;
+  size_t bytes_allocated;
+  size_t objects_allocated;
+  /* what the heap held right after the last collection */
+  size_t live_bytes;
+  size_t live_objects;
+  /* the times the program stopped for a collection or a step of */
+  /* one, and for how many seconds, in all and at the longest */
+  unsigned long pauses;
+  double pause_total;
+  double pause_max;
+};
+
 struct gc {
   void (*init)(void);
-  void (*collect)(void);
+  /* whether it did any work, which it only does once gc_wanted */
+  /* is set */
+  int (*collect)(void);
   struct exp *(*alloc_exp)(enum exp_type type);
-  struct env *(*alloc_env)(struct env *parent);
+  struct env *(*alloc_env)(size_t size);
+  /* the write barrier, or NULL for a collector without one */
+  void (*write)(struct exp *exp);
+  /* fills in all but the pauses */
+  void (*stats)(struct gc_stats *stats);
 };
 extern struct gc gc_nop;
 extern struct gc gc_ms;
 extern struct gc gc_copy;
+extern struct gc gc_gen;
+
+/* besides the globals, the roots are what the evaluators and */
+/* escapes hold on their own stacks, see gc.c */
+extern void gc_roots(void (*exp)(struct exp **),
+                     void (*env)(struct env **));
+
+/* a collector sets gc_wanted once enough has been allocated since */
+/* it last ran. it never collects in the middle of an allocation, */
+/* since c code may hold exps the roots do not show. instead the */
+/* evaluators collect at safe points, where all they hold is on */
+/* their stacks, unless safe points are turned off. */
+extern int gc_wanted;
+extern int gc_safepoints;
+#define GC_SAFEPOINT()                                  \
+  do {                                                  \
+    if (gc_wanted && gc_safepoints) {                   \
+      gc_pause();                                       \
+    }                                                   \
+  } while (0)
+
+/* collects, timing how long the program is stopped for it */
+extern void gc_pause(void);
+extern void gc_stats(struct gc_stats *stats);
+/* prints the stats, at exit with --gc-stats */
+extern void gc_report(void);
+/* seconds from some fixed point, for timing */
+extern double gc_clock(void);
+
+/* every store of a pointer into an exp that already existed goes */
+/* through GC_WRITE first: a global or a box by ENV_CELL_SET and */
+/* the evaluators, a vector by vector-set!, and so on. stores into */
+/* an exp that was just allocated, before anything else has run, */
+/* need not. */
+#define GC_WRITE(exp)                                   \
+  do {                                                  \
+    if (gc->write != NULL) {                            \
+      (*gc->write)(exp);                                \
+    }                                                   \
+  } while (0)
 #endif
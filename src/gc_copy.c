@@ -1,20 +1,30 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "config.h"
+#include "cont.h"
+#include "err.h"
 #include "exp.h"
 #include "env.h"
 #include "gc.h"
+#include "jit.h"
+#include "symtab.h"
+#include "vm.h"
 #include "util/vector.h"
 
 static void gc_init(void);
-static void gc_collect(void);
+static int gc_collect(void);
 static struct exp *gc_alloc_exp(enum exp_type type);
-static struct env *gc_alloc_env(struct env *parent);
+static struct env *gc_alloc_env(size_t size);
+static void gc_count(struct gc_stats *stats);
 
 struct gc gc_copy = {
   .init = &gc_init,
   .collect = &gc_collect,
   .alloc_exp = &gc_alloc_exp,
-  .alloc_env = &gc_alloc_env
+  .alloc_env = &gc_alloc_env,
+  .stats = &gc_count
 };
 
 enum record_type {
@@ -22,166 +32,352 @@ enum record_type {
   ENV
 };
 
+/* every object follows a header with its size, since envs vary. */
+/* space says which collection copied or allocated it, and once it */
+/* has been copied, forward is where to. */
 struct record {
-  union {
-    struct exp exp;
-    struct env env;
-  } data;
   enum record_type type;
-  struct record *fwd;
+  unsigned char space;
+  size_t size;
+  void *forward;
 };
 
-struct frame {
-  size_t capacity;
-  struct record *data;
-  struct record *next;
-  struct record *end;
+#define RECORD(ptr) ((struct record *)(ptr) - 1)
+#define DATA(rec) ((void *)((rec) + 1))
+#define ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/* a semispace is a list of chunks, each filled from the bottom up */
+/* by bumping a pointer. one that fills up is followed by another, */
+/* since a collection has to wait for a safe point. */
+struct chunk {
+  struct chunk *next;
+  char *top;
+  char *end;
+  char data[];
 };
 
-static const size_t frame_min_size = 1024;
+struct space {
+  struct chunk *first;
+  struct chunk *last;
+};
 
-static struct frame *frame_new(size_t capacity) {
-  struct frame *frame = malloc(sizeof *frame);
-  frame->capacity = capacity > 0 ? capacity : frame_min_size;
-  frame->data = calloc(frame->capacity, sizeof *frame->data);
-  frame->next = frame->data;
-  frame->end = frame->next + frame->capacity;
-  return frame;
-}
+static const size_t chunk_size = 1 << 20;
 
-static void frame_trim(struct frame *frame) {
-  size_t capacity = (frame->next - frame->data) * 10;
-  capacity = capacity > frame_min_size ? capacity : frame_min_size;
-  /* log if capacity < frame->capacity */
-  frame->capacity = capacity;
-  frame->data = realloc(frame->data, frame->capacity * sizeof *frame->data);
-}
+/* allocation is in from. a collection copies what is reachable */
+/* into to, and the two swap. */
+static struct space from;
+static struct space to;
+static unsigned char current;
 
-static void frame_free(struct frame *frame) {
-  free(frame->data);
-  free(frame);
-}
+/* the exps that own memory outside the heap, which is freed for */
+/* the ones a collection leaves behind */
+static struct vector *owners;
+
+static struct {
+  size_t live_bytes;
+  size_t live_objects;
+  size_t bytes;
+  size_t objects;
+  size_t trigger;
+  int over;
+} heap;
 
-struct {
-  struct frame *root;
-  struct frame *swap;
-} gc;
+static struct gc_stats totals;
 
-void gc_init(void) {
-  gc.root = frame_new(0);
+static size_t gc_limit(size_t bytes) {
+  return config.heap_max > 0 && bytes > config.heap_max ?
+    config.heap_max : bytes;
 }
 
-static struct exp *gc_copy_exp(struct exp *exp);
-static struct env *gc_copy_env(struct env *env);
+static void gc_init(void) {
+  owners = vector_new(0);
+  heap.trigger = gc_limit(config.heap_initial);
+}
 
-void gc_collect(void) {
+static void gc_adapt(void) {
+  double trigger = heap.live_bytes * config.heap_growth;
+  heap.trigger = trigger > config.heap_initial ?
+    gc_limit((size_t)trigger) : gc_limit(config.heap_initial);
+  heap.over = config.heap_max > 0 && heap.live_bytes >= config.heap_max;
+}
 
+static struct record *gc_bump(struct space *space, size_t size) {
+  size_t need = sizeof(struct record) + ALIGN(size);
+  struct chunk *chunk = space->last;
+  struct record *rec;
+  if (chunk == NULL || need > (size_t)(chunk->end - chunk->top)) {
+    size_t capacity = need > chunk_size ? need : chunk_size;
+    chunk = malloc(sizeof *chunk + capacity);
+    if (chunk == NULL && space == &to) {
+      /* half copied, the heap cannot be handed back to the program */
+      fprintf(stderr, "gc: out of memory while collecting\n");
+      exit(1);
+    } else if (chunk == NULL) {
+      err_error("gc: out of memory", NULL);
+    }
+    chunk->next = NULL;
+    chunk->top = chunk->data;
+    chunk->end = chunk->data + capacity;
+    if (space->last != NULL) {
+      space->last->next = chunk;
+    } else {
+      space->first = chunk;
+    }
+    space->last = chunk;
+  }
+  rec = (struct record *)chunk->top;
+  chunk->top += need;
+  return rec;
 }
 
-static void _gc_collect(void) {
-  gc.swap = frame_new(gc.root->capacity * 10);
-  gc_copy_env(&global_env);
-  frame_trim(gc.swap);
-  frame_free(gc.root);
-  gc.root = gc.swap;
-  gc.swap = NULL;
+static void gc_free_space(struct space *space) {
+  struct chunk *chunk = space->first;
+  while (chunk != NULL) {
+    struct chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  space->first = NULL;
+  space->last = NULL;
 }
-#include <stdio.h>
-static void *gc_alloc(enum record_type type) {
-  if (gc.root->next == gc.root->end) {
-    printf("starting collection... ");
-    _gc_collect();
-    printf("done\n");
-  }
-  struct record *rec = gc.root->next;
-  gc.root->next += 1;
+
+static void *gc_alloc(enum record_type type, size_t size) {
+  struct record *rec;
+  if (heap.over) {
+    /* once, so the error can be reported and the stacks unwound */
+    heap.over = 0;
+    err_error("gc: heap limit exceeded", NULL);
+  }
+  rec = gc_bump(&from, size);
   rec->type = type;
-  return rec;
+  rec->space = current;
+  rec->size = size;
+  rec->forward = NULL;
+  memset(DATA(rec), 0, size);
+  heap.bytes += sizeof *rec + ALIGN(size);
+  heap.objects += 1;
+  totals.bytes_allocated += sizeof *rec + ALIGN(size);
+  totals.objects_allocated += 1;
+  if (heap.live_bytes + heap.bytes >= heap.trigger) {
+    gc_wanted = 1;
+  }
+  return DATA(rec);
 }
 
-struct exp *gc_alloc_exp(enum exp_type type) {
-  struct exp *e = gc_alloc(EXP);
+static struct exp *gc_alloc_exp(enum exp_type type) {
+  struct exp *e = gc_alloc(EXP, sizeof *e);
   e->type = type;
+  switch (type) {
+  case SYMBOL:
+  case STRING:
+  case VECTOR:
+  case FUNCTION:
+  case CLOSURE:
+  case PROTO:
+  case CONTINUATION:
+    vector_push(owners, e);
+    break;
+  default:
+    break;
+  }
   return e;
 }
 
-struct env *gc_alloc_env(struct env *parent) {
-  struct env *e = gc_alloc(ENV);
-  e->parent = parent;
+static struct env *gc_alloc_env(size_t size) {
+  struct env *e = gc_alloc(ENV, sizeof *e + size * sizeof *e->slots);
+  e->size = size;
   return e;
 }
 
-#define IS_NOT(x) (ptr != (x))
-
-static int gc_is_managed(void *ptr) {
-  return IS_NOT(&global_env) &&
-    IS_NOT(OK) &&
-    IS_NOT(NIL) &&
-    IS_NOT(TRUE) &&
-    IS_NOT(FALSE);
+/* where an object is after this collection, copying it into to */
+/* the first time it is reached. what is already in to stays. */
+static void *gc_forward(void *ptr) {
+  struct record *rec;
+  struct record *copy;
+  if (ptr == NULL || EXP_IS_IMMEDIATE(ptr)) {
+    return ptr;
+  }
+  rec = RECORD(ptr);
+  if (rec->space == current) {
+    return ptr;
+  }
+  if (rec->forward == NULL) {
+    copy = gc_bump(&to, rec->size);
+    memcpy(copy, rec, sizeof *rec + rec->size);
+    copy->space = current;
+    rec->forward = DATA(copy);
+  }
+  return rec->forward;
 }
 
-#undef IS_NOT
+static void gc_copy_ref(struct exp **ref) {
+  *ref = gc_forward(*ref);
+}
 
-#define COPY(x, type) (x = gc_copy_##type(x))
+static void gc_copy_env_ref(struct env **ref) {
+  *ref = gc_forward(*ref);
+}
 
-#define MAYBE_COPY(type)                                \
-  do {                                                  \
-    if (gc_is_managed(type)) {                          \
-      struct record *rec = (struct record *)type;       \
-      if (rec->fwd == NULL) {                           \
-        *gc.swap->next = *rec;                          \
-        rec->fwd = gc.swap->next;                       \
-        type = (struct type *)gc.swap->next;            \
-        gc.swap->next += 1;                             \
-      } else {                                          \
-        return (struct type *)rec->fwd;                 \
-      }                                                 \
-    }                                                   \
-  } while (0)
+/* updates the references of an object that has been copied */
+static void gc_scan(struct record *rec) {
+  if (rec->type == ENV) {
+    struct env *env = DATA(rec);
+    size_t i;
+    for (i = 0; i < env->size; i += 1) {
+      gc_copy_ref(&env->slots[i]);
+    }
+    return;
+  }
+  {
+    struct exp *exp = DATA(rec);
+    switch (exp->type) {
+    case PAIR:
+      gc_copy_ref(&exp->value.pair.first);
+      gc_copy_ref(&exp->value.pair.rest);
+      break;
+    case VECTOR:
+      {
+        size_t length = vector_length(exp->value.vector);
+        size_t i;
+        for (i = 0; i < length; i += 1) {
+          vector_put(exp->value.vector, i,
+                     gc_forward(vector_get(exp->value.vector, i)));
+        }
+        break;
+      }
+    case CLOSURE:
+      gc_copy_ref(&exp->value.closure.lambda);
+      gc_copy_env_ref(&exp->value.closure.env);
+      break;
+    case NODE:
+      gc_copy_ref(&exp->value.node.a);
+      gc_copy_ref(&exp->value.node.b);
+      gc_copy_ref(&exp->value.node.c);
+      gc_copy_ref(&exp->value.node.d);
+      break;
+    case PROTO:
+      {
+        size_t i;
+        struct proto *proto = exp->value.proto;
+        for (i = 0; i < proto->nconsts; i += 1) {
+          gc_copy_ref(&proto->consts[i]);
+        }
+        break;
+      }
+    case CONTINUATION:
+      cont_each(exp->value.cont, &gc_copy_ref, &gc_copy_env_ref);
+      break;
+    case CELL:
+      gc_copy_ref(&exp->value.cell.symbol);
+      gc_copy_ref(&exp->value.cell.value);
+      break;
+    default:
+      break;
+    }
+  }
+}
 
-static struct exp *gc_copy_exp(struct exp *exp) {
-  MAYBE_COPY(exp);
+static void gc_release(struct exp *exp) {
   switch (exp->type) {
-  case PAIR:
-    COPY(exp->value.pair.first, exp);
-    COPY(exp->value.pair.rest, exp);
+  case SYMBOL:
+    free(exp->value.symbol);
+    break;
+  case STRING:
+    free(exp->value.string);
     break;
   case VECTOR:
-    {
-      size_t len = vector_length(exp->value.vector);
-      size_t i;
-      for (i = 0; i < len; i += 1) {
-        struct exp *item = vector_get(exp->value.vector, i);
-        vector_put(exp->value.vector, i, gc_copy_exp(item));
-      }
-    }
+    vector_free(&exp->value.vector, NULL);
+    break;
+  case FUNCTION:
+    free(exp->value.function.name);
     break;
   case CLOSURE:
-    COPY(exp->value.closure.params, exp);
-    COPY(exp->value.closure.body, exp);
-    COPY(exp->value.closure.env, env);
+    free(exp->value.closure.name);
+    break;
+  case PROTO:
+    jit_free(exp->value.proto);
+    free(exp->value.proto->code);
+    free(exp->value.proto->consts);
+    free(exp->value.proto);
+    break;
+  case CONTINUATION:
+    cont_free(exp->value.cont);
     break;
   default:
     break;
   }
-  return exp;
 }
 
-/* it would be nice if this only traversed global_env once */
-static struct env *gc_copy_env(struct env *env) {
-  MAYBE_COPY(env);
-  struct binding *b = env->bindings;
-  while (b != NULL) {
-    COPY(b->value, exp);
-    b = b->next;
+static struct exp *gc_symbol_alive(struct exp *symbol) {
+  return RECORD(symbol)->forward;
+}
+
+/* the owners that were copied are owners at their new address */
+static void gc_release_dead(void) {
+  size_t length = vector_length(owners);
+  size_t kept = 0;
+  size_t i;
+  for (i = 0; i < length; i += 1) {
+    struct exp *exp = vector_get(owners, i);
+    if (RECORD(exp)->forward != NULL) {
+      vector_put(owners, kept, RECORD(exp)->forward);
+      kept += 1;
+    } else {
+      gc_release(exp);
+    }
   }
-  if (env->parent != NULL) {
-    COPY(env->parent, env);
+  vector_resize(owners, kept, NULL);
+}
+
+/* cheney's algorithm: the roots are copied, and then the copies */
+/* are scanned in the order they were made, copying whatever they */
+/* refer to onto the end, until the scan catches up */
+static int gc_collect(void) {
+  struct chunk *chunk;
+  size_t i;
+  if (!gc_wanted) {
+    return 0;
+  }
+  current = !current;
+  env_globals(&gc_copy_ref);
+  gc_roots(&gc_copy_ref, &gc_copy_env_ref);
+  for (i = 0; i < KEYWORD_COUNT; i += 1) {
+    gc_copy_ref(&keywords[i]);
+  }
+  heap.live_objects = 0;
+  for (chunk = to.first; chunk != NULL; chunk = chunk->next) {
+    char *scan = chunk->data;
+    while (scan < chunk->top) {
+      struct record *rec = (struct record *)scan;
+      gc_scan(rec);
+      scan += sizeof *rec + ALIGN(rec->size);
+      heap.live_objects += 1;
+    }
+  }
+  symtab_sweep(&gc_symbol_alive);
+  gc_release_dead();
+  heap.live_bytes = 0;
+  for (chunk = to.first; chunk != NULL; chunk = chunk->next) {
+    heap.live_bytes += chunk->top - chunk->data;
   }
-  return env;
+  gc_free_space(&from);
+  from = to;
+  to.first = NULL;
+  to.last = NULL;
+  gc_adapt();
+  heap.bytes = 0;
+  heap.objects = 0;
+  gc_wanted = 0;
+  totals.collections += 1;
+  totals.live_bytes = heap.live_bytes;
+  totals.live_objects = heap.live_objects;
+  return 1;
 }
 
-#undef MAYBE_COPY
+static void gc_count(struct gc_stats *stats) {
+  *stats = totals;
+}
 
-#undef COPY
+#undef RECORD
+#undef DATA
+#undef ALIGN
@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "cont.h"
+#include "err.h"
+#include "exp.h"
+#include "env.h"
+#include "gc.h"
+#include "jit.h"
+#include "symtab.h"
+#include "vm.h"
+#include "util/vector.h"
+
+static void gc_init(void);
+static int gc_collect(void);
+static struct exp *gc_alloc_exp(enum exp_type type);
+static struct env *gc_alloc_env(size_t size);
+static void gc_write(struct exp *exp);
+static void gc_count(struct gc_stats *stats);
+
+struct gc gc_gen = {
+  .init = &gc_init,
+  .collect = &gc_collect,
+  .alloc_exp = &gc_alloc_exp,
+  .alloc_env = &gc_alloc_env,
+  .write = &gc_write,
+  .stats = &gc_count
+};
+
+enum record_type {
+  EXP,
+  ENV
+};
+
+/* new objects are bump allocated in the nursery, each after a */
+/* header with its size. a minor collection copies the ones still */
+/* reachable into the old space, leaving their new addresses in */
+/* the headers for the references it has yet to update, and then */
+/* starts the nursery over. */
+struct young {
+  enum record_type type;
+  size_t size;
+  void *forward;
+};
+
+/* the old space is a list of records, each allocated on its own */
+/* and marked and swept as gc_ms does, by a major collection */
+struct record {
+  enum record_type type;
+  unsigned char mark;
+  unsigned char remembered;
+  struct record *next;
+};
+
+#define YOUNG(ptr) ((struct young *)(ptr) - 1)
+#define RECORD(ptr) ((struct record *)(ptr) - 1)
+#define DATA(rec) ((void *)((rec) + 1))
+#define ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static const size_t nursery_size = 1 << 21;
+
+static struct {
+  char *start;
+  char *next;
+  /* past here it asks for a collection */
+  char *limit;
+  char *end;
+} nursery;
+
+#define IS_YOUNG(ptr)                                                   \
+  ((char *)(ptr) >= nursery.start && (char *)(ptr) < nursery.end)
+
+static struct record root;
+
+/* whether a collection is under way, which running out of memory */
+/* cannot be unwound from */
+static int collecting;
+
+/* the old objects that may point into the nursery, so the roots */
+/* of a minor collection besides the evaluators' stacks: those */
+/* written since the last one, and those allocated in the old */
+/* space since, whose fields were set without a barrier */
+static struct vector *remembered;
+
+/* the young exps that own memory outside the heap, which a minor */
+/* collection frees for the ones that die */
+static struct vector *owners;
+
+/* objects reached but not yet scanned */
+static struct vector *grey;
+
+/* the old space, as gc_ms keeps its heap */
+static struct {
+  size_t live_bytes;
+  size_t live_objects;
+  size_t bytes;
+  size_t objects;
+  size_t trigger;
+  int over;
+} heap;
+
+/* allocations count in whichever space they are made, and not */
+/* again when they are promoted */
+static struct gc_stats totals;
+
+static size_t gc_limit(size_t bytes) {
+  return config.heap_max > 0 && bytes > config.heap_max ?
+    config.heap_max : bytes;
+}
+
+static void gc_out_of_memory(void) {
+  if (collecting) {
+    fprintf(stderr, "gc: out of memory while collecting\n");
+    exit(1);
+  }
+  err_error("gc: out of memory", NULL);
+}
+
+static void gc_init(void) {
+  nursery.start = malloc(nursery_size);
+  if (nursery.start == NULL) {
+    fprintf(stderr, "gc: no memory for the nursery\n");
+    exit(1);
+  }
+  nursery.next = nursery.start;
+  nursery.limit = nursery.start + nursery_size - nursery_size / 8;
+  nursery.end = nursery.start + nursery_size;
+  remembered = vector_new(0);
+  owners = vector_new(0);
+  grey = vector_new(0);
+  heap.trigger = gc_limit(config.heap_initial);
+}
+
+static void gc_adapt(void) {
+  double trigger = heap.live_bytes * config.heap_growth;
+  heap.trigger = trigger > config.heap_initial ?
+    gc_limit((size_t)trigger) : gc_limit(config.heap_initial);
+  heap.over = config.heap_max > 0 && heap.live_bytes >= config.heap_max;
+}
+
+static void gc_remember(void *ptr) {
+  RECORD(ptr)->remembered = 1;
+  vector_push(remembered, ptr);
+}
+
+static void *gc_old(enum record_type type, size_t size) {
+  struct record *rec = malloc(sizeof *rec + size);
+  if (rec == NULL) {
+    gc_out_of_memory();
+  }
+  rec->type = type;
+  rec->mark = 0;
+  rec->remembered = 0;
+  rec->next = root.next;
+  root.next = rec;
+  heap.bytes += sizeof *rec + size;
+  heap.objects += 1;
+  if (heap.live_bytes + heap.bytes >= heap.trigger) {
+    gc_wanted = 1;
+  }
+  return DATA(rec);
+}
+
+static void *gc_alloc(enum record_type type, size_t size) {
+  size_t need = sizeof(struct young) + ALIGN(size);
+  void *ptr;
+  if (heap.over) {
+    heap.over = 0;
+    err_error("gc: heap limit exceeded", NULL);
+  }
+  if (need <= (size_t)(nursery.end - nursery.next)) {
+    struct young *y = (struct young *)nursery.next;
+    nursery.next += need;
+    if (nursery.next > nursery.limit) {
+      gc_wanted = 1;
+    }
+    y->type = type;
+    y->size = size;
+    y->forward = NULL;
+    ptr = y + 1;
+    totals.bytes_allocated += need;
+  } else {
+    /* a collection must wait for a safe point, so until then the */
+    /* old space takes what the nursery cannot */
+    gc_wanted = 1;
+    ptr = gc_old(type, size);
+    gc_remember(ptr);
+    totals.bytes_allocated += sizeof(struct record) + size;
+  }
+  totals.objects_allocated += 1;
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+static struct exp *gc_alloc_exp(enum exp_type type) {
+  struct exp *e;
+  switch (type) {
+  case SYMBOL:
+    /* symbols and cells live long, and keeping them out of the */
+    /* nursery means a minor collection need not look at the */
+    /* symbol table or the globals */
+    e = gc_old(EXP, sizeof *e);
+    memset(e, 0, sizeof *e);
+    totals.bytes_allocated += sizeof(struct record) + sizeof *e;
+    totals.objects_allocated += 1;
+    break;
+  case CELL:
+    e = gc_old(EXP, sizeof *e);
+    memset(e, 0, sizeof *e);
+    gc_remember(e);
+    totals.bytes_allocated += sizeof(struct record) + sizeof *e;
+    totals.objects_allocated += 1;
+    break;
+  default:
+    e = gc_alloc(EXP, sizeof *e);
+    break;
+  }
+  e->type = type;
+  if (IS_YOUNG(e)) {
+    switch (type) {
+    case STRING:
+    case VECTOR:
+    case FUNCTION:
+    case CLOSURE:
+    case PROTO:
+    case CONTINUATION:
+      vector_push(owners, e);
+      break;
+    default:
+      break;
+    }
+  }
+  return e;
+}
+
+static struct env *gc_alloc_env(size_t size) {
+  struct env *e = gc_alloc(ENV, sizeof *e + size * sizeof *e->slots);
+  e->size = size;
+  return e;
+}
+
+static void gc_write(struct exp *exp) {
+  if (!IS_YOUNG(exp) && !RECORD(exp)->remembered) {
+    gc_remember(exp);
+  }
+}
+
+/* calls exp and env on every reference an old object holds */
+static void gc_scan(void *ptr, void (*exp)(struct exp **),
+                    void (*env)(struct env **)) {
+  if (RECORD(ptr)->type == ENV) {
+    struct env *e = ptr;
+    size_t i;
+    for (i = 0; i < e->size; i += 1) {
+      (*exp)(&e->slots[i]);
+    }
+    return;
+  }
+  {
+    struct exp *e = ptr;
+    switch (e->type) {
+    case PAIR:
+      (*exp)(&e->value.pair.first);
+      (*exp)(&e->value.pair.rest);
+      break;
+    case VECTOR:
+      {
+        size_t i;
+        size_t length = vector_length(e->value.vector);
+        for (i = 0; i < length; i += 1) {
+          struct exp *item = vector_get(e->value.vector, i);
+          (*exp)(&item);
+          vector_put(e->value.vector, i, item);
+        }
+        break;
+      }
+    case CLOSURE:
+      (*exp)(&e->value.closure.lambda);
+      (*env)(&e->value.closure.env);
+      break;
+    case NODE:
+      (*exp)(&e->value.node.a);
+      (*exp)(&e->value.node.b);
+      (*exp)(&e->value.node.c);
+      (*exp)(&e->value.node.d);
+      break;
+    case PROTO:
+      {
+        size_t i;
+        struct proto *proto = e->value.proto;
+        for (i = 0; i < proto->nconsts; i += 1) {
+          (*exp)(&proto->consts[i]);
+        }
+        break;
+      }
+    case CONTINUATION:
+      cont_each(e->value.cont, exp, env);
+      break;
+    case CELL:
+      (*exp)(&e->value.cell.symbol);
+      (*exp)(&e->value.cell.value);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static void gc_release(struct exp *exp) {
+  switch (exp->type) {
+  case SYMBOL:
+    free(exp->value.symbol);
+    break;
+  case STRING:
+    free(exp->value.string);
+    break;
+  case VECTOR:
+    vector_free(&exp->value.vector, NULL);
+    break;
+  case FUNCTION:
+    free(exp->value.function.name);
+    break;
+  case CLOSURE:
+    free(exp->value.closure.name);
+    break;
+  case PROTO:
+    jit_free(exp->value.proto);
+    free(exp->value.proto->code);
+    free(exp->value.proto->consts);
+    free(exp->value.proto);
+    break;
+  case CONTINUATION:
+    cont_free(exp->value.cont);
+    break;
+  default:
+    break;
+  }
+}
+
+/* where a young object has gone, copying it into the old space */
+/* the first time it is reached */
+static void *gc_promote(void *ptr) {
+  struct young *y;
+  if (ptr == NULL || EXP_IS_IMMEDIATE(ptr) || !IS_YOUNG(ptr)) {
+    return ptr;
+  }
+  y = YOUNG(ptr);
+  if (y->forward == NULL) {
+    y->forward = gc_old(y->type, y->size);
+    memcpy(y->forward, ptr, y->size);
+    vector_push(grey, y->forward);
+  }
+  return y->forward;
+}
+
+static void gc_forward(struct exp **ref) {
+  *ref = gc_promote(*ref);
+}
+
+static void gc_forward_env(struct env **ref) {
+  *ref = gc_promote(*ref);
+}
+
+/* the work is in proportion to what survives and what was written */
+/* to, not to the size of the old space */
+static void gc_minor(void) {
+  gc_roots(&gc_forward, &gc_forward_env);
+  while (!vector_empty(remembered)) {
+    void *ptr = vector_pop(remembered);
+    RECORD(ptr)->remembered = 0;
+    gc_scan(ptr, &gc_forward, &gc_forward_env);
+  }
+  while (!vector_empty(grey)) {
+    gc_scan(vector_pop(grey), &gc_forward, &gc_forward_env);
+  }
+  while (!vector_empty(owners)) {
+    struct exp *exp = vector_pop(owners);
+    if (YOUNG(exp)->forward == NULL) {
+      gc_release(exp);
+    }
+  }
+  nursery.next = nursery.start;
+}
+
+static void gc_mark_ptr(void *ptr) {
+  if (ptr == NULL || EXP_IS_IMMEDIATE(ptr) || RECORD(ptr)->mark) {
+    return;
+  }
+  RECORD(ptr)->mark = 1;
+  vector_push(grey, ptr);
+}
+
+static void gc_mark(struct exp **ref) {
+  gc_mark_ptr(*ref);
+}
+
+static void gc_mark_env(struct env **ref) {
+  gc_mark_ptr(*ref);
+}
+
+static struct exp *gc_symbol_alive(struct exp *symbol) {
+  return RECORD(symbol)->mark ? symbol : NULL;
+}
+
+static size_t gc_size(struct record *rec) {
+  if (rec->type == ENV) {
+    struct env *env = DATA(rec);
+    return sizeof *rec + sizeof *env + env->size * sizeof *env->slots;
+  } else {
+    return sizeof *rec + sizeof(struct exp);
+  }
+}
+
+static void gc_sweep(void) {
+  struct record *prev = &root;
+  struct record *curr = prev->next;
+  heap.live_bytes = 0;
+  heap.live_objects = 0;
+  while (curr != NULL) {
+    if (curr->mark) {
+      curr->mark = 0;
+      heap.live_bytes += gc_size(curr);
+      heap.live_objects += 1;
+      prev = curr;
+      curr = curr->next;
+    } else {
+      prev->next = curr->next;
+      if (curr->type == EXP) {
+        gc_release(DATA(curr));
+      }
+      free(curr);
+      curr = prev->next;
+    }
+  }
+}
+
+/* only ever right after a minor collection, so everything is old */
+static void gc_major(void) {
+  size_t i;
+  env_globals(&gc_mark);
+  gc_roots(&gc_mark, &gc_mark_env);
+  for (i = 0; i < KEYWORD_COUNT; i += 1) {
+    gc_mark(&keywords[i]);
+  }
+  while (!vector_empty(grey)) {
+    gc_scan(vector_pop(grey), &gc_mark, &gc_mark_env);
+  }
+  symtab_sweep(&gc_symbol_alive);
+  gc_sweep();
+  gc_adapt();
+  heap.bytes = 0;
+  heap.objects = 0;
+}
+
+static int gc_collect(void) {
+  if (!gc_wanted) {
+    return 0;
+  }
+  collecting = 1;
+  gc_minor();
+  if (heap.live_bytes + heap.bytes >= heap.trigger) {
+    gc_major();
+  }
+  collecting = 0;
+  gc_wanted = 0;
+  /* after a minor collection, the old space is all there is */
+  totals.collections += 1;
+  totals.live_bytes = heap.live_bytes + heap.bytes;
+  totals.live_objects = heap.live_objects + heap.objects;
+  return 1;
+}
+
+static void gc_count(struct gc_stats *stats) {
+  *stats = totals;
+}
+
+#undef YOUNG
+#undef RECORD
+#undef DATA
+#undef ALIGN
+#undef IS_YOUNG
@@ -1,20 +1,47 @@
+#define _DEFAULT_SOURCE
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "config.h"
+#include "cont.h"
+#include "err.h"
 #include "exp.h"
 #include "env.h"
 #include "gc.h"
+#include "jit.h"
+#include "symtab.h"
+#include "vm.h"
+#include "util/deque.h"
 #include "util/vector.h"
 
+/* with gcc on unix, the marking can be shared among threads and */
+/* the sweeping done by another in the background */
+#if defined(__unix__) && defined(__GNUC__)
+#define THREADS 1
+#include <pthread.h>
+#include <sched.h>
+#else
+#define THREADS 0
+#endif
+
 static void gc_init(void);
-static void gc_collect(void);
+static int gc_collect(void);
 static struct exp *gc_alloc_exp(enum exp_type type);
-static struct env *gc_alloc_env(struct env *parent);
+static struct env *gc_alloc_env(size_t size);
+static void gc_write(struct exp *exp);
+static void gc_count(struct gc_stats *stats);
 
 struct gc gc_ms = {
   .init = &gc_init,
   .collect = &gc_collect,
   .alloc_exp = &gc_alloc_exp,
-  .alloc_env = &gc_alloc_env
+  .alloc_env = &gc_alloc_env,
+  .write = &gc_write,
+  .stats = &gc_count
 };
 
 enum record_type {
@@ -22,183 +49,994 @@ enum record_type {
   ENV
 };
 
-enum mark_type {
-  WHITE,
-  BLACK
+/* the heap is made of pages aligned to their size, so the page of */
+/* an object is its address with the low bits cleared. a page holds */
+/* objects of one type and size class in equal slots, and its */
+/* header keeps their mark bits and which slots are in use, so */
+/* marking never writes to the objects themselves. an env too big */
+/* for any class gets a large page of its own. */
+struct page {
+  enum record_type type;
+  size_t size;
+  size_t count;
+  size_t live;
+  char *objects;
+  /* the free slots, linked through their first word, and where */
+  /* the slots that have never been used begin */
+  void *free;
+  char *fresh;
+  /* whether any exp here owns memory outside the heap */
+  int owners;
+  /* every page of its class, and those with free slots */
+  struct page *next;
+  struct page *next_free;
+  /* what malloc returned for a large page, or NULL */
+  void *block;
+  size_t words;
+  /* words of mark bits, of in-use bits and of grey bits */
+  unsigned long bits[];
 };
 
-struct record {
-  union {
-    struct exp exp;
-    struct env env;
-  } data;
+struct class {
   enum record_type type;
-  enum mark_type mark;
-  struct record *next;
+  size_t size;
+  struct page *pages;
+  struct page *free;
+  /* the pages the last collection marked and has yet to sweep, */
+  /* and those the sweeper has swept that have room */
+  struct page *unswept;
+  struct page *swept;
 };
 
-static struct record root;
+#define PAGE_SIZE ((size_t)1 << 16)
+#define ARENA_PAGES 16
+#define BITS (sizeof(unsigned long) * CHAR_BIT)
 
-static void gc_maybe_mark(void *ptr);
-static int gc_should_proceed(void *ptr);
-static void gc_mark_exp(struct exp *exp);
-static void gc_mark_env(struct env *env);
-static void gc_sweep(void);
-static void gc_free(struct record *rec);
+#define PAGE(ptr)                                                       \
+  ((struct page *)((uintptr_t)(ptr) & ~(uintptr_t)(PAGE_SIZE - 1)))
+#define ALIGN(n) (((n) + 15) & ~(uintptr_t)15)
+#define MARKS(page) ((page)->bits)
+#define IN_USE(page) ((page)->bits + (page)->words)
+#define GREYS(page) ((page)->bits + 2 * (page)->words)
 
-static void gc_init(void) {
+/* exps are all one size. each env class is a half or a third */
+/* bigger than the last, so at most a third of a slot is wasted. */
+static const size_t env_sizes[] = {
+  16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+#define NCLASSES (1 + sizeof env_sizes / sizeof env_sizes[0])
+
+static struct class classes[NCLASSES];
+
+/* large pages, and the pages no class is using */
+static struct page *large;
+static struct page *spare;
+
+/* what survived the last collection, what has been allocated */
+/* since, and how many bytes the heap may reach before the next */
+static struct {
+  size_t live_bytes;
+  size_t live_objects;
+  size_t bytes;
+  size_t objects;
+  size_t trigger;
+  /* set when a collection could not get under config.heap_max */
+  int over;
+} heap;
+
+/* objects marked but not yet scanned */
+static struct vector *grey;
+
+/* with config.gc_step set, a collection is done a step at a time */
+/* between stretches of the program: first what is left of the */
+/* last sweep, then the marking. allocated counts the objects */
+/* allocated since the last step, and rushed is set once the heap */
+/* has grown too far for the cycle to go on a step at a time. */
+static struct {
+  enum { IDLE, SWEEPING, MARKING } phase;
+  size_t allocated;
+  int rushed;
+} cycle;
+
+/* a marker has a deque of the objects it has marked but not yet */
+/* scanned, which the others steal from when theirs run out. the */
+/* first is the thread that collects. */
+struct marker {
+  struct deque *deque;
+  size_t live_bytes;
+  size_t live_objects;
+  /* seconds spent scanning rather than looking for work */
+  double busy;
+};
+
+static size_t nmarkers = 1;
+
+/* the time spent marking all at once, and the time the markers */
+/* spent working in it, which is that much more for each thread */
+/* that kept busy */
+static struct {
+  double marking;
+  double busy;
+} stats;
 
+static struct gc_stats totals;
+
+#if THREADS
+static struct marker *markers;
+
+/* the marker of the thread, while marking is shared */
+static __thread struct marker *self;
+
+/* the other markers wait for a new round, and the collecting */
+/* thread for them all to finish it. idle counts the markers out */
+/* of work, and once it is all of them, there is none left. */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long round;
+  size_t running;
+  size_t idle;
+} pool = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER, 0, 0, 0
+};
+
+/* while the sweeper is on, lock guards the lists of pages: the */
+/* classes' pages, unswept and swept, and the spares. a class's */
+/* free list and the pages on it belong to the program's thread. */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  int on;
+  int busy;
+} sweeper = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER, 0, 0
+};
+#else
+static struct marker *self;
+#endif
+
+static void gc_mark(void *ptr);
+static void gc_scan(void *ptr);
+static size_t gc_sweep_next(struct class *class, struct page **room);
+static struct page *gc_sweep_some(struct class *class);
+static void gc_sweep_all(void);
+static void gc_sweep_wait(void);
+static void gc_sweep_large(void);
+static void gc_drain(void);
+static void gc_release(struct exp *exp);
+
+static void gc_lock(void) {
+#if THREADS
+  if (sweeper.on) {
+    pthread_mutex_lock(&sweeper.lock);
+  }
+#endif
 }
 
-static void gc_collect(void) {
-  gc_mark_env(&global_env);
-  gc_sweep();
+static void gc_unlock(void) {
+#if THREADS
+  if (sweeper.on) {
+    pthread_mutex_unlock(&sweeper.lock);
+  }
+#endif
 }
 
-static void gc_mark_exp(struct exp *exp) {
-  if (!gc_should_proceed(exp)) {
-    return;
+static void gc_report_marking(void) {
+  fprintf(stderr, "gc: %.1fms marking all at once\n", stats.marking * 1e3);
+  if (nmarkers > 1) {
+    fprintf(stderr, "gc: %lu mark threads worked %.1fms in all, "
+            "%.2f of them busy on average\n",
+            (unsigned long)nmarkers, stats.busy * 1e3,
+            stats.marking > 0 ? stats.busy / stats.marking : 1.0);
   }
-  gc_maybe_mark(exp);
-  switch (exp->type) {
-  case PAIR:
-    gc_mark_exp(exp->value.pair.first);
-    gc_mark_exp(exp->value.pair.rest);
-    break;
-  case VECTOR:
-    {
-      size_t i;
-      size_t length = vector_length(exp->value.vector);
-      for (i = 0; i < length; i += 1) {
-        gc_mark_exp(vector_get(exp->value.vector, i));
-      }
+}
+
+static size_t gc_limit(size_t bytes) {
+  return config.heap_max > 0 && bytes > config.heap_max ?
+    config.heap_max : bytes;
+}
+
+#if THREADS
+static void gc_work(struct marker *m);
+static void *gc_sweeper(void *arg);
+
+static void *gc_marker(void *arg) {
+  unsigned long round = 0;
+  self = arg;
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (pool.round == round) {
+      pthread_cond_wait(&pool.start, &pool.lock);
+    }
+    round = pool.round;
+    pthread_mutex_unlock(&pool.lock);
+    gc_work(self);
+    pthread_mutex_lock(&pool.lock);
+    pool.running -= 1;
+    if (pool.running == 0) {
+      pthread_cond_signal(&pool.done);
+    }
+  }
+  return NULL;
+}
+
+/* as many markers as threads can be started for, counting the */
+/* thread that collects. the threads live as long as the program. */
+static void gc_threads_init(void) {
+  pthread_t thread;
+  markers = calloc(config.gc_threads, sizeof *markers);
+  markers[0].deque = deque_new();
+  for (nmarkers = 1; nmarkers < config.gc_threads; nmarkers += 1) {
+    struct marker *m = &markers[nmarkers];
+    m->deque = deque_new();
+    if (pthread_create(&thread, NULL, &gc_marker, m) != 0) {
+      deque_free(&m->deque);
+      break;
+    }
+    pthread_detach(thread);
+  }
+  if (pthread_create(&thread, NULL, &gc_sweeper, NULL) == 0) {
+    pthread_detach(thread);
+    sweeper.on = 1;
+  }
+}
+#endif
+
+static void gc_init(void) {
+  size_t i;
+  classes[0].type = EXP;
+  classes[0].size = sizeof(struct exp);
+  for (i = 1; i < NCLASSES; i += 1) {
+    classes[i].type = ENV;
+    classes[i].size = env_sizes[i - 1];
+  }
+  grey = vector_new(0);
+  heap.trigger = gc_limit(config.heap_initial);
+#if THREADS
+  if (config.gc_threads > 1) {
+    gc_threads_init();
+  }
+#endif
+  if (config.gc_stats) {
+    atexit(&gc_report_marking);
+  }
+}
+
+/* the heap may grow by a factor of what survived, so the room */
+/* left to allocate follows the survivor rate: a program that */
+/* keeps most of what it makes collects less often, and one that */
+/* keeps little stays near the initial size */
+static void gc_adapt(void) {
+  double trigger = heap.live_bytes * config.heap_growth;
+  heap.trigger = trigger > config.heap_initial ?
+    gc_limit((size_t)trigger) : gc_limit(config.heap_initial);
+  heap.over = config.heap_max > 0 && heap.live_bytes >= config.heap_max;
+}
+
+/* lays out a page for count slots of size bytes, or as many as */
+/* fit if count is 0 */
+static void gc_page_init(struct page *page, enum record_type type,
+                         size_t size, size_t count) {
+  size_t room = count > 0 ? 0 : PAGE_SIZE - sizeof *page;
+  size_t words;
+  char *objects;
+  if (count == 0) {
+    count = room / size;
+  }
+  for (;;) {
+    words = (count + BITS - 1) / BITS;
+    objects = (char *)ALIGN((uintptr_t)(page->bits + 3 * words));
+    if (room == 0 ||
+        (size_t)(objects - (char *)page) + count * size <= PAGE_SIZE) {
       break;
     }
+    count -= 1;
+  }
+  page->type = type;
+  page->size = size;
+  page->count = count;
+  page->live = 0;
+  page->objects = objects;
+  page->free = NULL;
+  page->fresh = objects;
+  page->owners = 0;
+  page->next = NULL;
+  page->next_free = NULL;
+  page->words = words;
+  memset(page->bits, 0, 3 * words * sizeof *page->bits);
+}
+
+/* a page from the spares, which come from malloc a few at a time */
+static struct page *gc_page_take(void) {
+  struct page *page;
+  gc_lock();
+  if (spare == NULL) {
+    char *arena = malloc((ARENA_PAGES + 1) * PAGE_SIZE);
+    char *first;
+    size_t i;
+    if (arena == NULL) {
+      gc_unlock();
+      err_error("gc: out of memory", NULL);
+    }
+    first = (char *)PAGE(arena + PAGE_SIZE - 1);
+    for (i = 0; i < ARENA_PAGES; i += 1) {
+      page = (struct page *)(first + i * PAGE_SIZE);
+      page->next = spare;
+      spare = page;
+    }
+  }
+  page = spare;
+  spare = page->next;
+  gc_unlock();
+  return page;
+}
+
+static void *gc_alloc_large(size_t size) {
+  size_t header = sizeof(struct page) + 3 * sizeof(unsigned long) + 16;
+  void *block = malloc(header + size + PAGE_SIZE);
+  struct page *page;
+  if (block == NULL) {
+    err_error("gc: out of memory", NULL);
+  }
+  page = PAGE((char *)block + PAGE_SIZE - 1);
+  gc_page_init(page, ENV, size, 1);
+  page->block = block;
+  page->next = large;
+  large = page;
+  page->live = 1;
+  page->fresh = page->objects + size;
+  IN_USE(page)[0] = 1;
+  if (cycle.phase == MARKING) {
+    gc_mark(page->objects);
+  }
+  return page->objects;
+}
+
+static size_t gc_slot(struct page *page, void *ptr) {
+  return ((char *)ptr - page->objects) / page->size;
+}
+
+static int gc_is_marked(void *ptr) {
+  struct page *page = PAGE(ptr);
+  size_t i = gc_slot(page, ptr);
+  return (MARKS(page)[i / BITS] >> (i % BITS)) & 1;
+}
+
+static int gc_page_full(struct page *page) {
+  return page->free == NULL &&
+    page->fresh == page->objects + page->count * page->size;
+}
+
+static void *gc_alloc(struct class *class) {
+  struct page *page = class->free;
+  void **slot;
+  size_t i;
+  if (page == NULL) {
+    gc_lock();
+    page = class->free = class->swept;
+    class->swept = NULL;
+    gc_unlock();
+  }
+  if (page == NULL) {
+    page = gc_sweep_some(class);
+  }
+  if (page == NULL) {
+    page = gc_page_take();
+    gc_page_init(page, class->type, class->size, 0);
+    page->block = NULL;
+    gc_lock();
+    page->next = class->pages;
+    class->pages = page;
+    gc_unlock();
+    class->free = page;
+  }
+  if (page->free != NULL) {
+    slot = page->free;
+    page->free = *slot;
+  } else {
+    slot = (void **)page->fresh;
+    page->fresh += page->size;
+  }
+  if (gc_page_full(page)) {
+    class->free = page->next_free;
+  }
+  i = gc_slot(page, slot);
+  IN_USE(page)[i / BITS] |= 1UL << (i % BITS);
+  page->live += 1;
+  memset(slot, 0, page->size);
+  if (cycle.phase == MARKING) {
+    gc_mark(slot);
+  }
+  return slot;
+}
+
+static void gc_account(size_t size) {
+  if (heap.over) {
+    /* once, so the error can be reported and the stacks unwound */
+    heap.over = 0;
+    err_error("gc: heap limit exceeded", NULL);
+  }
+  heap.bytes += size;
+  heap.objects += 1;
+  totals.bytes_allocated += size;
+  totals.objects_allocated += 1;
+  if (cycle.phase != IDLE) {
+    /* a step is asked for every half step of allocation, and the */
+    /* cycle is finished at once if it lets the heap grow to twice */
+    /* its trigger, or past the limit */
+    cycle.allocated += 1;
+    if (cycle.allocated >= (config.gc_step > 1 ? config.gc_step / 2 : 1)) {
+      gc_wanted = 1;
+    }
+    if (totals.live_bytes + heap.bytes >= gc_limit(2 * heap.trigger)) {
+      cycle.rushed = 1;
+      gc_wanted = 1;
+    }
+  } else if (heap.live_bytes + heap.bytes >= heap.trigger) {
+    gc_wanted = 1;
+  }
+}
+
+static struct exp *gc_alloc_exp(enum exp_type type) {
+  struct exp *e;
+  gc_account(classes[0].size);
+  e = gc_alloc(&classes[0]);
+  e->type = type;
+  switch (type) {
+  case SYMBOL:
+  case STRING:
+  case VECTOR:
+  case FUNCTION:
   case CLOSURE:
-    gc_mark_exp(exp->value.closure.params);
-    gc_mark_exp(exp->value.closure.body);
-    gc_mark_env(exp->value.closure.env);
+  case PROTO:
+  case CONTINUATION:
+    PAGE(e)->owners = 1;
     break;
   default:
     break;
   }
+  return e;
+}
+
+static struct env *gc_alloc_env(size_t size) {
+  size_t bytes = sizeof(struct env) + size * sizeof(struct exp *);
+  size_t i;
+  struct env *e;
+  for (i = 1; i < NCLASSES && classes[i].size < bytes; i += 1);
+  if (i < NCLASSES) {
+    gc_account(classes[i].size);
+    e = gc_alloc(&classes[i]);
+  } else {
+    gc_account(bytes);
+    e = gc_alloc_large(bytes);
+  }
+  e->size = size;
+  return e;
+}
+
+static struct exp *gc_symbol_alive(struct exp *symbol) {
+  return gc_is_marked(symbol) ? symbol : NULL;
+}
+
+static void gc_mark_ref(struct exp **ref) {
+  gc_mark(*ref);
+}
+
+static void gc_mark_env_ref(struct env **ref) {
+  gc_mark(*ref);
+}
+
+static void gc_mark_roots(void) {
+  size_t i;
+  env_globals(&gc_mark_ref);
+  gc_roots(&gc_mark_ref, &gc_mark_env_ref);
+  for (i = 0; i < KEYWORD_COUNT; i += 1) {
+    gc_mark(keywords[i]);
+  }
 }
 
-static void gc_mark_env(struct env *env) {
-  if (!gc_should_proceed(env)) {
+#if THREADS
+/* something to scan from another marker's deque */
+static void *gc_steal(struct marker *m) {
+  size_t i;
+  for (i = 1; i < nmarkers; i += 1) {
+    void *ptr = deque_steal(markers[(m - markers + i) % nmarkers].deque);
+    if (ptr != NULL) {
+      return ptr;
+    }
+  }
+  return NULL;
+}
+
+static int gc_work_left(void) {
+  size_t i;
+  for (i = 0; i < nmarkers; i += 1) {
+    if (!deque_empty(markers[i].deque)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* a marker only goes idle with its own deque empty, and an idle */
+/* one pushes nothing, so when all are idle the marking is done */
+static void gc_work(struct marker *m) {
+  double start = gc_clock();
+  void *ptr;
+  for (;;) {
+    while ((ptr = deque_pop(m->deque)) != NULL) {
+      gc_scan(ptr);
+    }
+    if ((ptr = gc_steal(m)) != NULL) {
+      gc_scan(ptr);
+      continue;
+    }
+    m->busy += gc_clock() - start;
+    __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (__atomic_load_n(&pool.idle, __ATOMIC_SEQ_CST) == nmarkers) {
+        return;
+      }
+      if (gc_work_left()) {
+        __atomic_sub_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      sched_yield();
+    }
+    start = gc_clock();
+  }
+}
+
+/* deals the grey stack out among the markers and marks with them */
+/* until they are all out of work */
+static void gc_drain_shared(void) {
+  size_t i;
+  for (i = 0; !vector_empty(grey); i += 1) {
+    deque_push(markers[i % nmarkers].deque, vector_pop(grey));
+  }
+  pool.idle = 0;
+  pthread_mutex_lock(&pool.lock);
+  pool.round += 1;
+  pool.running = nmarkers - 1;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+  self = &markers[0];
+  gc_work(self);
+  self = NULL;
+  pthread_mutex_lock(&pool.lock);
+  while (pool.running > 0) {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  for (i = 0; i < nmarkers; i += 1) {
+    heap.live_bytes += markers[i].live_bytes;
+    heap.live_objects += markers[i].live_objects;
+    stats.busy += markers[i].busy;
+    markers[i].live_bytes = 0;
+    markers[i].live_objects = 0;
+    markers[i].busy = 0;
+  }
+}
+#endif
+
+/* scans until the grey stack is empty */
+static void gc_drain(void) {
+  double start = gc_clock();
+#if THREADS
+  if (nmarkers > 1) {
+    gc_drain_shared();
+    stats.marking += gc_clock() - start;
     return;
   }
-  gc_maybe_mark(env);
-  struct binding *b = env->bindings;
-  while (b != NULL) {
-    gc_mark_exp(b->value);
-    b = b->next;
+#endif
+  while (!vector_empty(grey)) {
+    gc_scan(vector_pop(grey));
   }
-  if (env->parent != NULL) {
-    gc_mark_env(env->parent);
+  stats.marking += gc_clock() - start;
+}
+
+/* the roots are marked again, since the stacks and the globals */
+/* table have no write barrier. the sweeping is left for gc_alloc */
+/* to do a page at a time, and the sweeper if there is one, except */
+/* for large pages, which are few. */
+static void gc_finish(void) {
+  size_t i;
+  gc_mark_roots();
+  gc_drain();
+  symtab_sweep(&gc_symbol_alive);
+  gc_lock();
+  for (i = 0; i < NCLASSES; i += 1) {
+    classes[i].unswept = classes[i].pages;
+    classes[i].pages = NULL;
+    classes[i].free = NULL;
+    classes[i].swept = NULL;
+  }
+#if THREADS
+  if (sweeper.on) {
+    pthread_cond_signal(&sweeper.wake);
   }
+#endif
+  gc_unlock();
+  gc_sweep_large();
+  totals.collections += 1;
+  totals.live_bytes = heap.live_bytes;
+  totals.live_objects = heap.live_objects;
+  gc_adapt();
+  heap.bytes = 0;
+  heap.objects = 0;
+  cycle.phase = IDLE;
+  cycle.allocated = 0;
+  cycle.rushed = 0;
+}
+
+static void gc_start(void) {
+  heap.live_bytes = 0;
+  heap.live_objects = 0;
+  cycle.phase = MARKING;
+  gc_mark_roots();
 }
 
-static void gc_sweep(void) {
-  struct record *prev = &root;
-  struct record *curr = prev->next;
-  while (curr != NULL) {
-    if (curr->mark) {
-      curr->mark = WHITE;
-      prev = curr;
-      curr = curr->next;
-    } else {
-      prev->next = curr->next;
-      gc_free(curr);
-      curr = prev->next;
+/* sweeps or marks about budget objects. the objects allocated */
+/* while marking start grey, so that what they keep alive is */
+/* marked in steps and not all at the end. */
+static void gc_step(size_t budget) {
+  size_t i;
+  if (cycle.phase == IDLE) {
+    cycle.phase = SWEEPING;
+  }
+  for (i = 0; i < NCLASSES && cycle.phase == SWEEPING; i += 1) {
+    size_t swept;
+    while (budget > 0 &&
+           (swept = gc_sweep_next(&classes[i], &classes[i].free)) > 0) {
+      budget -= budget < swept ? budget : swept;
     }
+    if (budget == 0) {
+      return;
+    }
+  }
+  if (cycle.phase == SWEEPING) {
+    gc_sweep_wait();
+    gc_start();
+  }
+  while (budget > 0 && !vector_empty(grey)) {
+    gc_scan(vector_pop(grey));
+    budget -= 1;
+  }
+  if (vector_empty(grey)) {
+    gc_finish();
   }
 }
 
-static void *gc_alloc(enum record_type type) {
-  struct record *rec = calloc(1, sizeof *rec);
-  rec->type = type;
-  rec->next = root.next;
-  root.next = rec;
-  return rec;
+/* marking takes as long as what is live, unless it is done in */
+/* steps. either way it waits until allocation asks for it. */
+static int gc_collect(void) {
+  if (!gc_wanted) {
+    return 0;
+  }
+  gc_wanted = 0;
+  if (config.gc_step > 0 && !cycle.rushed) {
+    /* at least twice what was allocated, which started grey, so */
+    /* that the marking catches up */
+    size_t budget = 2 * cycle.allocated;
+    cycle.allocated = 0;
+    gc_step(budget > config.gc_step ? budget : config.gc_step);
+    return 1;
+  }
+  if (cycle.phase != MARKING) {
+    gc_sweep_all();
+    gc_start();
+  }
+  gc_drain();
+  gc_finish();
+  return 1;
 }
 
-static struct exp *gc_alloc_exp(enum exp_type type) {
-  struct exp *e = gc_alloc(EXP);
-  e->type = type;
-  return e;
+static void gc_count(struct gc_stats *stats) {
+  *stats = totals;
 }
 
-static struct env *gc_alloc_env(struct env *parent) {
-  struct env *e = gc_alloc(ENV);
-  e->parent = parent;
-  return e;
+/* an object the marking has scanned must be scanned again if a */
+/* reference is stored in it */
+static void gc_write(struct exp *exp) {
+  struct page *page;
+  size_t i;
+  unsigned long bit;
+  if (cycle.phase != MARKING || EXP_IS_IMMEDIATE(exp)) {
+    return;
+  }
+  page = PAGE(exp);
+  i = gc_slot(page, exp);
+  bit = 1UL << (i % BITS);
+  if ((MARKS(page)[i / BITS] & bit) && !(GREYS(page)[i / BITS] & bit)) {
+    GREYS(page)[i / BITS] |= bit;
+    vector_push(grey, exp);
+  }
 }
 
-static void gc_free(struct record *rec) {
-  switch (rec->type) {
-  case EXP:
-    switch (rec->data.exp.type) {
-    case SYMBOL:
-      free(rec->data.exp.value.symbol);
-      break;
-    case STRING:
-      free(rec->data.exp.value.string);
-      break;
-    case VECTOR:
-      vector_free(&rec->data.exp.value.vector, NULL);
-      break;
-    case FUNCTION:
-      free(rec->data.exp.value.function.name);
-      break;
-    case CLOSURE:
-      free(rec->data.exp.value.closure.name);
-      break;
-    default:
+/* marks an object and pushes it on the grey stack for its fields */
+/* to be marked in turn, so how deep the heap goes costs stack */
+/* space on the heap rather than c stack */
+static void gc_mark(void *ptr) {
+  struct page *page;
+  size_t i;
+  unsigned long bit;
+  if (ptr == NULL || EXP_IS_IMMEDIATE(ptr)) {
+    return;
+  }
+  page = PAGE(ptr);
+  i = gc_slot(page, ptr);
+  bit = 1UL << (i % BITS);
+#if THREADS
+  if (self != NULL) {
+    /* the bit may be set by another marker at the same time */
+    if (__atomic_fetch_or(&MARKS(page)[i / BITS], bit, __ATOMIC_RELAXED) &
+        bit) {
+      return;
+    }
+    self->live_bytes += page->size;
+    self->live_objects += 1;
+    deque_push(self->deque, ptr);
+    return;
+  }
+#endif
+  if (MARKS(page)[i / BITS] & bit) {
+    return;
+  }
+  MARKS(page)[i / BITS] |= bit;
+  GREYS(page)[i / BITS] |= bit;
+  heap.live_bytes += page->size;
+  heap.live_objects += 1;
+  vector_push(grey, ptr);
+}
+
+static void gc_scan(void *ptr) {
+  struct exp *exp = ptr;
+  struct page *page = PAGE(ptr);
+  size_t i = gc_slot(page, ptr);
+  if (self == NULL) {
+    /* the sweep clears them after marking that is shared */
+    GREYS(page)[i / BITS] &= ~(1UL << (i % BITS));
+  }
+  if (page->type == ENV) {
+    struct env *env = ptr;
+    size_t i;
+    for (i = 0; i < env->size; i += 1) {
+      gc_mark(env->slots[i]);
+    }
+    return;
+  }
+  switch (exp->type) {
+  case PAIR:
+    gc_mark(exp->value.pair.first);
+    gc_mark(exp->value.pair.rest);
+    break;
+  case VECTOR:
+    {
+      size_t i;
+      size_t length = vector_length(exp->value.vector);
+      for (i = 0; i < length; i += 1) {
+        gc_mark(vector_get(exp->value.vector, i));
+      }
       break;
     }
+  case CLOSURE:
+    gc_mark(exp->value.closure.lambda);
+    gc_mark(exp->value.closure.env);
     break;
-  case ENV:
+  case NODE:
+    gc_mark(exp->value.node.a);
+    gc_mark(exp->value.node.b);
+    gc_mark(exp->value.node.c);
+    gc_mark(exp->value.node.d);
+    break;
+  case PROTO:
     {
-      struct binding *prev = NULL;
-      struct binding *curr = rec->data.env.bindings;
-      while (curr != NULL) {
-        free(curr->symbol);
-        prev = curr;
-        curr = curr->next;
-        free(prev);
+      size_t i;
+      struct proto *proto = exp->value.proto;
+      for (i = 0; i < proto->nconsts; i += 1) {
+        gc_mark(proto->consts[i]);
       }
+      break;
     }
+  case CONTINUATION:
+    cont_each(exp->value.cont, &gc_mark_ref, &gc_mark_env_ref);
+    break;
+  case CELL:
+    gc_mark(exp->value.cell.symbol);
+    gc_mark(exp->value.cell.value);
     break;
   default:
-    /* error */
     break;
   }
-  free(rec);
 }
 
-static int gc_is_managed(void *ptr) {
-#define IS_NOT(x) (ptr != (x))
-  return IS_NOT(&global_env) &&
-    IS_NOT(OK) &&
-    IS_NOT(NIL) &&
-    IS_NOT(TRUE) &&
-    IS_NOT(FALSE);
-#undef IS_NOT
+/* the slots in use and unmarked are dead: their exps give back */
+/* what they own, and unless the whole page is dead, the slots go */
+/* on its free list. the marks are cleared for next time. returns */
+/* how many are live. */
+static size_t gc_sweep_page(struct page *page) {
+  size_t w;
+  int empty = 1;
+  for (w = 0; w < page->words && empty; w += 1) {
+    empty = MARKS(page)[w] == 0;
+  }
+  if (empty && !page->owners) {
+    page->live = 0;
+    return 0;
+  }
+  for (w = 0; w < page->words; w += 1) {
+    unsigned long dead = IN_USE(page)[w] & ~MARKS(page)[w];
+    char *slot = page->objects + w * BITS * page->size;
+    for (; dead != 0; dead >>= 1, slot += page->size) {
+      if (!(dead & 1)) {
+        continue;
+      }
+      if (page->type == EXP) {
+        gc_release((struct exp *)slot);
+      }
+      if (!empty) {
+        *(void **)slot = page->free;
+        page->free = slot;
+      }
+      page->live -= 1;
+    }
+    IN_USE(page)[w] &= MARKS(page)[w];
+    MARKS(page)[w] = 0;
+    GREYS(page)[w] = 0;
+  }
+  return page->live;
 }
 
-static void gc_maybe_mark(void *ptr) {
-  if (gc_is_managed(ptr)) {
-    struct record *rec = ptr;
-    rec->mark = BLACK;
+/* sweeps the next of the class's pages left from the last */
+/* collection, and returns how many slots it has, or 0 if none */
+/* were left. if the page has room, it goes on the list given: */
+/* the class's free list for gc_alloc, its swept list for the */
+/* sweeper. a page left empty gc_alloc uses as if new, and the */
+/* sweeper gives back to the spares. */
+static size_t gc_sweep_next(struct class *class, struct page **room) {
+  struct page *page;
+  size_t count;
+  size_t live;
+  gc_lock();
+  page = class->unswept;
+  if (page != NULL) {
+    class->unswept = page->next;
+  }
+  gc_unlock();
+  if (page == NULL) {
+    return 0;
   }
+  count = page->count;
+  live = gc_sweep_page(page);
+  gc_lock();
+  if (live == 0 && room != &class->free) {
+    page->next = spare;
+    spare = page;
+  } else {
+    if (live == 0) {
+      gc_page_init(page, class->type, class->size, 0);
+    }
+    page->next = class->pages;
+    class->pages = page;
+    if (!gc_page_full(page)) {
+      page->next_free = *room;
+      *room = page;
+    }
+  }
+  gc_unlock();
+  return count;
 }
 
-static int gc_should_proceed(void *ptr) {
-  if (gc_is_managed(ptr)) {
-    struct record *rec = ptr;
-    return rec->mark == WHITE;
-  } else {
-    return ptr == &global_env;
+/* sweeps until a page has room */
+static struct page *gc_sweep_some(struct class *class) {
+  while (class->free == NULL && gc_sweep_next(class, &class->free) > 0);
+  return class->free;
+}
+
+/* waits out the page the sweeper is on */
+static void gc_sweep_wait(void) {
+#if THREADS
+  if (sweeper.on) {
+    pthread_mutex_lock(&sweeper.lock);
+    while (sweeper.busy) {
+      pthread_cond_wait(&sweeper.idle, &sweeper.lock);
+    }
+    pthread_mutex_unlock(&sweeper.lock);
+  }
+#endif
+}
+
+/* the marks must all be cleared before the next collection sets */
+/* any */
+static void gc_sweep_all(void) {
+  size_t i;
+  for (i = 0; i < NCLASSES; i += 1) {
+    while (gc_sweep_next(&classes[i], &classes[i].free) > 0);
+  }
+  gc_sweep_wait();
+}
+
+#if THREADS
+/* sweeps the pages a collection leaves, a class at a time, while */
+/* the program runs */
+static void *gc_sweeper(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&sweeper.lock);
+  for (;;) {
+    size_t i;
+    for (i = 0; i < NCLASSES && classes[i].unswept == NULL; i += 1);
+    if (i == NCLASSES) {
+      sweeper.busy = 0;
+      pthread_cond_broadcast(&sweeper.idle);
+      pthread_cond_wait(&sweeper.wake, &sweeper.lock);
+      continue;
+    }
+    sweeper.busy = 1;
+    pthread_mutex_unlock(&sweeper.lock);
+    gc_sweep_next(&classes[i], &classes[i].swept);
+    pthread_mutex_lock(&sweeper.lock);
+  }
+  return NULL;
+}
+#endif
+
+static void gc_sweep_large(void) {
+  struct page **link = &large;
+  while (*link != NULL) {
+    struct page *page = *link;
+    if (!(MARKS(page)[0] & 1)) {
+      *link = page->next;
+      free(page->block);
+      continue;
+    }
+    MARKS(page)[0] = 0;
+    GREYS(page)[0] = 0;
+    link = &page->next;
+  }
+}
+
+static void gc_release(struct exp *exp) {
+  switch (exp->type) {
+  case SYMBOL:
+    free(exp->value.symbol);
+    break;
+  case STRING:
+    free(exp->value.string);
+    break;
+  case VECTOR:
+    vector_free(&exp->value.vector, NULL);
+    break;
+  case FUNCTION:
+    free(exp->value.function.name);
+    break;
+  case CLOSURE:
+    free(exp->value.closure.name);
+    break;
+  case PROTO:
+    jit_free(exp->value.proto);
+    free(exp->value.proto->code);
+    free(exp->value.proto->consts);
+    free(exp->value.proto);
+    break;
+  case CONTINUATION:
+    cont_free(exp->value.cont);
+    break;
+  default:
+    break;
   }
 }
+
+#undef PAGE_SIZE
+#undef ARENA_PAGES
+#undef BITS
+#undef PAGE
+#undef ALIGN
+#undef MARKS
+#undef IN_USE
+#undef GREYS
+#undef NCLASSES
@@ -5,33 +5,48 @@
 #include "gc.h"
 
 static void gc_init(void);
-static void gc_collect(void);
+static int gc_collect(void);
 static struct exp *gc_alloc_exp(enum exp_type type);
-static struct env *gc_alloc_env(struct env *parent);
+static struct env *gc_alloc_env(size_t size);
+static void gc_count(struct gc_stats *stats);
 
 struct gc gc_nop = {
   .init = &gc_init,
   .collect = &gc_collect,
   .alloc_exp = &gc_alloc_exp,
-  .alloc_env = &gc_alloc_env
+  .alloc_env = &gc_alloc_env,
+  .stats = &gc_count
 };
 
+/* nothing is ever freed, so all of it stays live */
+static struct gc_stats totals;
+
 static void gc_init(void) {
 
 }
 
-static void gc_collect(void) {
-
+static int gc_collect(void) {
+  return 0;
 }
 
 static struct exp *gc_alloc_exp(enum exp_type type) {
   struct exp *e = calloc(1, sizeof *e);
   e->type = type;
+  totals.bytes_allocated += sizeof *e;
+  totals.objects_allocated += 1;
   return e;
 }
 
-static struct env *gc_alloc_env(struct env *parent) {
-  struct env *e = calloc(1, sizeof *e);
-  e->parent = parent;
+static struct env *gc_alloc_env(size_t size) {
+  struct env *e = calloc(1, sizeof *e + size * sizeof *e->slots);
+  e->size = size;
+  totals.bytes_allocated += sizeof *e + size * sizeof *e->slots;
+  totals.objects_allocated += 1;
   return e;
 }
+
+static void gc_count(struct gc_stats *stats) {
+  *stats = totals;
+  stats->live_bytes = totals.bytes_allocated;
+  stats->live_objects = totals.objects_allocated;
+}
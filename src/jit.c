@@ -0,0 +1,431 @@
+#define _DEFAULT_SOURCE
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+#include "err.h"
+#include "exp.h"
+#include "jit.h"
+#include "vm.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+/* native code is entered like this. it loads and stores *sp */
+/* itself, and returns the pc of the instruction to go on with. */
+typedef size_t (*jit_fn)(struct exp ***sp, struct exp **locals,
+                         struct exp **captured, size_t pc);
+
+struct jit_code {
+  void *mem;
+  size_t size;
+  jit_fn fn;
+  /* the native address of each bytecode instruction */
+  void **entries;
+};
+
+/* code is emitted into a plain buffer and only copied into */
+/* executable memory once it is complete */
+struct buffer {
+  unsigned char *bytes;
+  size_t length;
+  size_t capacity;
+};
+
+/* a rel32 at some offset that must point at an instruction, or at */
+/* the exit for an instruction */
+struct fixup {
+  size_t at;
+  size_t pc;
+  int exit;
+};
+
+struct jit {
+  struct proto *proto;
+  struct buffer buf;
+  struct fixup *fixups;
+  size_t nfixups;
+  size_t cfixups;
+  /* the native offset of each instruction and of its exit */
+  size_t *labels;
+  size_t *exits;
+  size_t epilogue;
+};
+
+static void grow(struct buffer *buf, size_t n) {
+  if (buf->length + n > buf->capacity) {
+    buf->capacity = buf->capacity ? buf->capacity * 2 : 256;
+    if (buf->length + n > buf->capacity) {
+      buf->capacity = buf->length + n;
+    }
+    buf->bytes = realloc(buf->bytes, buf->capacity);
+  }
+}
+
+static void put(struct buffer *buf, size_t n, ...) {
+  va_list ap;
+  size_t i;
+  grow(buf, n);
+  va_start(ap, n);
+  for (i = 0; i < n; i += 1) {
+    buf->bytes[buf->length++] = (unsigned char)va_arg(ap, int);
+  }
+  va_end(ap);
+}
+
+static void put32(struct buffer *buf, uint32_t x) {
+  put(buf, 4, x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, x >> 24);
+}
+
+static void put64(struct buffer *buf, uint64_t x) {
+  put32(buf, (uint32_t)x);
+  put32(buf, (uint32_t)(x >> 32));
+}
+
+/* leaves room for a rel32 to the instruction at pc, or its exit */
+static void target(struct jit *jit, size_t pc, int exit) {
+  if (jit->nfixups == jit->cfixups) {
+    jit->cfixups = jit->cfixups ? jit->cfixups * 2 : 64;
+    jit->fixups = realloc(jit->fixups, jit->cfixups * sizeof *jit->fixups);
+  }
+  jit->fixups[jit->nfixups].at = jit->buf.length;
+  jit->fixups[jit->nfixups].pc = pc;
+  jit->fixups[jit->nfixups].exit = exit;
+  jit->nfixups += 1;
+  put32(&jit->buf, 0);
+}
+
+/* registers while native code runs: */
+/*   rbx  the vm stack pointer */
+/*   r12  locals */
+/*   r13  the captured slots of the closure */
+/*   r14  the constants of the proto */
+/*   r15  where the stack pointer goes back to on exit */
+
+#define DISP(exp, field) ((uint32_t)offsetof(struct exp, field))
+
+static void jz_exit(struct jit *jit, size_t pc) {
+  put(&jit->buf, 2, 0x0f, 0x84);
+  target(jit, pc, 1);
+}
+
+static void jnz_exit(struct jit *jit, size_t pc) {
+  put(&jit->buf, 2, 0x0f, 0x85);
+  target(jit, pc, 1);
+}
+
+/* mov rax, [r14 + 8 * index] */
+static void load_const(struct jit *jit, size_t index) {
+  put(&jit->buf, 3, 0x49, 0x8b, 0x86);
+  put32(&jit->buf, (uint32_t)(index * sizeof(struct exp *)));
+}
+
+/* mov [rbx], rax; add rbx, 8 */
+static void push_rax(struct jit *jit) {
+  put(&jit->buf, 7, 0x48, 0x89, 0x03, 0x48, 0x83, 0xc3, 0x08);
+}
+
+/* sub rbx, 8 */
+static void drop(struct jit *jit) {
+  put(&jit->buf, 4, 0x48, 0x83, 0xeb, 0x08);
+}
+
+/* mov rax, [rax + value] */
+static void cell_value(struct jit *jit) {
+  put(&jit->buf, 3, 0x48, 0x8b, 0x80);
+  put32(&jit->buf, DISP(exp, value.cell.value));
+}
+
+/* a variable is NULL until its define has run. the vm reports */
+/* that, so native code just leaves. */
+static void push_bound(struct jit *jit, size_t pc) {
+  /* test rax, rax */
+  put(&jit->buf, 3, 0x48, 0x85, 0xc0);
+  jz_exit(jit, pc);
+  push_rax(jit);
+}
+
+/* follows the load of a frame or closure slot, whose opcode */
+/* bytes are already out */
+static void load_variable(struct jit *jit, unsigned int arg, size_t pc) {
+  put32(&jit->buf, (uint32_t)(VM_SLOT(arg) * sizeof(struct exp *)));
+  if (arg & VM_BOXED) {
+    cell_value(jit);
+  }
+  push_bound(jit, pc);
+}
+
+/* open-coded builtins leave when the global was redefined */
+static void guard(struct jit *jit, unsigned int arg, size_t pc) {
+  load_const(jit, arg);
+  /* cmp dword [rax + original], 0 */
+  put(&jit->buf, 2, 0x83, 0xb8);
+  put32(&jit->buf, DISP(exp, value.cell.original));
+  put(&jit->buf, 1, 0x00);
+  jz_exit(jit, pc);
+}
+
+/* rcx = sp[-2], rax = sp[-1] */
+static void load_two(struct jit *jit) {
+  put(&jit->buf, 8, 0x48, 0x8b, 0x4b, 0xf0, 0x48, 0x8b, 0x43, 0xf8);
+}
+
+/* both must be fixnums, which have the low bit set */
+static void fixnums(struct jit *jit, size_t pc) {
+  /* mov rdx, rax; and rdx, rcx; test dl, 1 */
+  put(&jit->buf, 9, 0x48, 0x89, 0xc2, 0x48, 0x21, 0xca, 0xf6, 0xc2, 0x01);
+  jz_exit(jit, pc);
+}
+
+/* sp[-2] = rdx, then one less on the stack */
+static void store_two(struct jit *jit) {
+  put(&jit->buf, 4, 0x48, 0x89, 0x53, 0xf0);
+  drop(jit);
+}
+
+/* rdx = rcx <cc> rax ? TRUE : FALSE */
+static void compare(struct jit *jit, int cc) {
+  put(&jit->buf, 1, 0xba);
+  put32(&jit->buf, (uint32_t)EXP_WORD(FALSE));
+  put(&jit->buf, 1, 0xbe);
+  put32(&jit->buf, (uint32_t)EXP_WORD(TRUE));
+  /* cmp rcx, rax; cmovcc rdx, rsi */
+  put(&jit->buf, 7, 0x48, 0x39, 0xc1, 0x48, 0x0f, cc, 0xd6);
+}
+
+static void pair_field(struct jit *jit, uint32_t field, size_t pc) {
+  /* mov rax, [rbx - 8]; test al, 3 */
+  put(&jit->buf, 6, 0x48, 0x8b, 0x43, 0xf8, 0xa8, 0x03);
+  jnz_exit(jit, pc);
+  /* cmp dword [rax + type], PAIR */
+  put(&jit->buf, 2, 0x83, 0xb8);
+  put32(&jit->buf, DISP(exp, type));
+  put(&jit->buf, 1, PAIR);
+  jnz_exit(jit, pc);
+  /* mov rax, [rax + field]; mov [rbx - 8], rax */
+  put(&jit->buf, 3, 0x48, 0x8b, 0x80);
+  put32(&jit->buf, field);
+  put(&jit->buf, 4, 0x48, 0x89, 0x43, 0xf8);
+}
+
+/* mov eax, pc; jmp epilogue */
+static void exit_at(struct jit *jit, size_t pc) {
+  put(&jit->buf, 1, 0xb8);
+  put32(&jit->buf, (uint32_t)pc);
+  put(&jit->buf, 1, 0xe9);
+  put32(&jit->buf, (uint32_t)(jit->epilogue - (jit->buf.length + 4)));
+}
+
+static void instruction(struct jit *jit, size_t pc) {
+  unsigned int w = jit->proto->code[pc];
+  unsigned int arg = VM_ARG(w);
+  switch (VM_OP(w)) {
+  case OP_CONST:
+    load_const(jit, arg);
+    push_rax(jit);
+    break;
+  case OP_LOCAL:
+    /* mov rax, [r12 + disp] */
+    put(&jit->buf, 4, 0x49, 0x8b, 0x84, 0x24);
+    load_variable(jit, arg, pc);
+    break;
+  case OP_FREE:
+    /* mov rax, [r13 + disp] */
+    put(&jit->buf, 3, 0x49, 0x8b, 0x85);
+    load_variable(jit, arg, pc);
+    break;
+  case OP_GLOBAL:
+    load_const(jit, arg);
+    cell_value(jit);
+    push_bound(jit, pc);
+    break;
+  case OP_POP:
+    drop(jit);
+    break;
+  case OP_JUMP:
+    put(&jit->buf, 1, 0xe9);
+    target(jit, arg, 0);
+    break;
+  case OP_JUMP_IF_FALSE:
+    /* sub rbx, 8; mov rax, [rbx]; cmp rax, FALSE; je */
+    drop(jit);
+    put(&jit->buf, 7, 0x48, 0x8b, 0x03, 0x48, 0x83, 0xf8,
+        (int)EXP_WORD(FALSE));
+    put(&jit->buf, 2, 0x0f, 0x84);
+    target(jit, arg, 0);
+    break;
+  case OP_JUMP_IF_TRUE:
+    /* mov rax, [rbx - 8]; cmp rax, FALSE; jne; sub rbx, 8 */
+    put(&jit->buf, 8, 0x48, 0x8b, 0x43, 0xf8, 0x48, 0x83, 0xf8,
+        (int)EXP_WORD(FALSE));
+    put(&jit->buf, 2, 0x0f, 0x85);
+    target(jit, arg, 0);
+    drop(jit);
+    break;
+  case OP_ADD:
+    guard(jit, arg, pc);
+    load_two(jit);
+    fixnums(jit, pc);
+    /* mov rdx, rcx; add rdx, rax; sub rdx, 1 */
+    put(&jit->buf, 10, 0x48, 0x89, 0xca, 0x48, 0x01, 0xc2,
+        0x48, 0x83, 0xea, 0x01);
+    store_two(jit);
+    break;
+  case OP_SUB:
+    guard(jit, arg, pc);
+    load_two(jit);
+    fixnums(jit, pc);
+    /* mov rdx, rcx; sub rdx, rax; add rdx, 1 */
+    put(&jit->buf, 10, 0x48, 0x89, 0xca, 0x48, 0x29, 0xc2,
+        0x48, 0x83, 0xc2, 0x01);
+    store_two(jit);
+    break;
+  case OP_NUM_EQ:
+    guard(jit, arg, pc);
+    load_two(jit);
+    fixnums(jit, pc);
+    compare(jit, 0x44);
+    store_two(jit);
+    break;
+  case OP_GT:
+    guard(jit, arg, pc);
+    load_two(jit);
+    fixnums(jit, pc);
+    compare(jit, 0x4f);
+    store_two(jit);
+    break;
+  case OP_EQ:
+    guard(jit, arg, pc);
+    load_two(jit);
+    compare(jit, 0x44);
+    store_two(jit);
+    break;
+  case OP_CAR:
+    guard(jit, arg, pc);
+    pair_field(jit, DISP(exp, value.pair.first), pc);
+    break;
+  case OP_CDR:
+    guard(jit, arg, pc);
+    pair_field(jit, DISP(exp, value.pair.rest), pc);
+    break;
+  default:
+    /* calls, closures, assignments and the rest go to the vm */
+    exit_at(jit, pc);
+    break;
+  }
+}
+
+void jit_compile(struct proto *proto) {
+  struct jit jit;
+  struct jit_code *native;
+  size_t pc;
+  size_t i;
+  size_t page;
+  memset(&jit, 0, sizeof jit);
+  jit.proto = proto;
+  jit.labels = malloc(proto->length * sizeof *jit.labels);
+  jit.exits = malloc(proto->length * sizeof *jit.exits);
+  native = malloc(sizeof *native);
+  native->entries = calloc(proto->length, sizeof *native->entries);
+
+  /* push rbx, r12-r15 */
+  put(&jit.buf, 9, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+  /* mov r15, rdi; mov rbx, [rdi]; mov r12, rsi; mov r13, rdx */
+  put(&jit.buf, 12, 0x49, 0x89, 0xff, 0x48, 0x8b, 0x1f,
+      0x49, 0x89, 0xf4, 0x49, 0x89, 0xd5);
+  /* mov r14, consts */
+  put(&jit.buf, 2, 0x49, 0xbe);
+  put64(&jit.buf, (uint64_t)(uintptr_t)proto->consts);
+  /* mov rax, entries; jmp [rax + 8 * rcx] */
+  put(&jit.buf, 2, 0x48, 0xb8);
+  put64(&jit.buf, (uint64_t)(uintptr_t)native->entries);
+  put(&jit.buf, 3, 0xff, 0x24, 0xc8);
+
+  /* mov [r15], rbx; pop r15-r12, rbx; ret */
+  jit.epilogue = jit.buf.length;
+  put(&jit.buf, 13, 0x49, 0x89, 0x1f, 0x41, 0x5f, 0x41, 0x5e,
+      0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3);
+
+  for (pc = 0; pc < proto->length; pc += VM_WIDTH(VM_OP(proto->code[pc]))) {
+    jit.labels[pc] = jit.buf.length;
+    instruction(&jit, pc);
+  }
+  /* the last instruction is always a return, which exits, so */
+  /* there is no falling off the end */
+  for (pc = 0; pc < proto->length; pc += VM_WIDTH(VM_OP(proto->code[pc]))) {
+    jit.exits[pc] = jit.buf.length;
+    exit_at(&jit, pc);
+  }
+  for (i = 0; i < jit.nfixups; i += 1) {
+    struct fixup *f = &jit.fixups[i];
+    size_t to = f->exit ? jit.exits[f->pc] : jit.labels[f->pc];
+    uint32_t rel = (uint32_t)(to - (f->at + 4));
+    memcpy(jit.buf.bytes + f->at, &rel, sizeof rel);
+  }
+
+  page = 4096;
+  native->size = (jit.buf.length + page - 1) / page * page;
+  native->mem = mmap(NULL, native->size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (native->mem == MAP_FAILED) {
+    err_error("jit: out of memory", NULL);
+  }
+  memcpy(native->mem, jit.buf.bytes, jit.buf.length);
+  if (mprotect(native->mem, native->size, PROT_READ | PROT_EXEC) != 0) {
+    err_error("jit: cannot make code executable", NULL);
+  }
+  /* iso c has no cast from object to function pointers */
+  memcpy(&native->fn, &native->mem, sizeof native->fn);
+  for (pc = 0; pc < proto->length; pc += VM_WIDTH(VM_OP(proto->code[pc]))) {
+    native->entries[pc] = (unsigned char *)native->mem + jit.labels[pc];
+  }
+  proto->native = native;
+
+  free(jit.buf.bytes);
+  free(jit.fixups);
+  free(jit.labels);
+  free(jit.exits);
+}
+
+size_t jit_run(struct proto *proto, struct exp ***sp,
+               struct exp **locals, struct env *captured, size_t pc) {
+  return (*proto->native->fn)(sp, locals,
+                              captured ? captured->slots : NULL, pc);
+}
+
+void jit_free(struct proto *proto) {
+  if (proto->native != NULL) {
+    munmap(proto->native->mem, proto->native->size);
+    free(proto->native->entries);
+    free(proto->native);
+    proto->native = NULL;
+  }
+}
+
+#else
+
+/* elsewhere there is no native code and the vm does everything */
+
+void jit_compile(struct proto *proto) {
+  (void)proto;
+}
+
+size_t jit_run(struct proto *proto, struct exp ***sp,
+               struct exp **locals, struct env *captured, size_t pc) {
+  (void)proto;
+  (void)sp;
+  (void)locals;
+  (void)captured;
+  return pc;
+}
+
+void jit_free(struct proto *proto) {
+  (void)proto;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef JIT_H
+#define JIT_H
+#include <stddef.h>
+/* the jit turns the bytecode of a proto into native code once it */
+/* has been called JIT_THRESHOLD times. native code works on the */
+/* vm stack just like the bytecode does, and hands control back */
+/* to the vm at any instruction it does not handle itself. */
+#define JIT_THRESHOLD 100
+struct exp;
+struct env;
+struct proto;
+extern void jit_compile(struct proto *proto);
+/* runs native code from the instruction at pc, and returns the */
+/* index of the instruction the vm should go on with */
+extern size_t jit_run(struct proto *proto, struct exp ***sp,
+                      struct exp **locals, struct env *captured, size_t pc);
+extern void jit_free(struct proto *proto);
+#endif
@@ -2,7 +2,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "aot.h"
 #include "config.h"
+#include "cont.h"
+#include "cstack.h"
 #include "env.h"
 #include "builtin.h"
 #include "err.h"
@@ -12,15 +15,23 @@
 #include "util/input.h"
 #include "print.h"
 #include "gc.h"
-
-struct env global_env;
+#include "symtab.h"
+#include "vm.h"
 
 static struct input *input;
 
 int main(int argc, char **argv) {
+  cstack_init();
   config_init(argc, argv);
   (*gc->init)();
-  builtin_defall(&global_env);
+  if (config.gc_stats) {
+    atexit(&gc_report);
+  }
+  symtab_init();
+  builtin_defall();
+  if (config.compile) {
+    return aot_compile(config.output);
+  }
   input = config_next_input();
   for (;;) {
     struct exp *e;
@@ -35,7 +46,7 @@ int main(int argc, char **argv) {
           continue;
         }
       }
-      e = eval(expand(e), &global_env);
+      e = eval(expand(e));
       if (!config.silent) {
         print(e);
       }
@@ -43,7 +54,13 @@ int main(int argc, char **argv) {
       char *msg = err_message();
       printf("error: %s\n", msg);
       free(msg);
+      vm_reset();
+      eval_reset();
+      cont_reset();
+    }
+    /* between forms is a safe point, even where calls are not */
+    if (gc_wanted) {
+      gc_pause();
     }
-    (*gc->collect)();
   }
 }
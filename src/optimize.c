@@ -0,0 +1,501 @@
+#include <string.h>
+
+#include "analyze.h"
+#include "builtin.h"
+#include "env.h"
+#include "exp.h"
+#include "optimize.h"
+#include "symtab.h"
+
+/* the optimizer runs after expansion and before analysis, and */
+/* rewrites core forms into simpler core forms. it folds calls to */
+/* pure builtins on constants, propagates constants and copies */
+/* bound by a lambda that is applied on the spot, drops branches */
+/* whose test is constant, and removes unused pure bindings. */
+
+/* a binding is one variable of an enclosing lambda. the chain */
+/* lives on the c stack and is searched innermost first. value is */
+/* what references to the variable are replaced with, if anything. */
+/* for a copy of another variable, target is that variable. */
+struct binding {
+  struct exp *symbol;
+  struct exp *value;
+  struct binding *target;
+  int flags;
+  struct binding *next;
+};
+
+enum {
+  BINDING_ASSIGNED = 1,
+  BINDING_DEFINED = 2
+};
+
+/* the toplevel form being optimized */
+static struct exp *form = NULL;
+
+/* whether calls to builtins may be folded in what is being */
+/* optimized: only in code that runs as soon as the form does, */
+/* and before anything could redefine them */
+static int folding = 0;
+
+static struct exp *optimize_in(struct exp *exp, struct binding *scope);
+static struct exp *optimize_quote(struct exp *exp, struct binding *scope);
+static struct exp *optimize_set(struct exp *exp, struct binding *scope);
+static struct exp *optimize_if(struct exp *exp, struct binding *scope);
+static struct exp *optimize_or(struct exp *exp, struct binding *scope);
+static struct exp *optimize_lambda(struct exp *exp, struct binding *scope);
+static struct exp *optimize_begin(struct exp *exp, struct binding *scope);
+static struct exp *optimize_apply(struct exp *exp, struct binding *scope);
+static struct exp *map_optimize(struct exp *exp, void *data);
+
+struct tag_optimize {
+  enum keyword tag;
+  struct exp *(*optimize)(struct exp *exp, struct binding *scope);
+};
+
+static struct tag_optimize tag_map[] = {
+  { .tag = KEYWORD_QUOTE, .optimize = &optimize_quote },
+  { .tag = KEYWORD_SET, .optimize = &optimize_set },
+  { .tag = KEYWORD_DEFINE, .optimize = &optimize_set },
+  { .tag = KEYWORD_IF, .optimize = &optimize_if },
+  { .tag = KEYWORD_OR, .optimize = &optimize_or },
+  { .tag = KEYWORD_LAMBDA, .optimize = &optimize_lambda },
+  { .tag = KEYWORD_BEGIN, .optimize = &optimize_begin }
+};
+
+/* builtins without side effects, which may be called at compile */
+/* time when all of their arguments are constant. divides marks */
+/* the ones whose second argument must not be zero. */
+struct foldable {
+  const char *name;
+  int divides;
+};
+
+static struct foldable fold_map[] = {
+  { .name = "number?" },
+  { .name = "pair?" },
+  { .name = "vector?" },
+  { .name = "symbol?" },
+  { .name = "string?" },
+  { .name = "procedure?" },
+  { .name = "+" },
+  { .name = "-" },
+  { .name = "*" },
+  { .name = "div", .divides = 1 },
+  { .name = "mod", .divides = 1 },
+  { .name = ">" },
+  { .name = "=" },
+  { .name = "eq?" },
+  { .name = "car" },
+  { .name = "cdr" }
+};
+
+#define NELEM(arr) ((sizeof arr) / (sizeof arr[0]))
+
+static int calls_out(struct exp *exp, struct exp *bound);
+static struct exp *binders(struct exp *exp, struct exp *found);
+
+struct exp *optimize(struct exp *exp) {
+  struct exp *outer = form;
+  int outer_folding = folding;
+  struct exp *result;
+  form = exp;
+  folding = !calls_out(exp, binders(exp, NIL));
+  result = optimize_in(exp, NULL);
+  form = outer;
+  folding = outer_folding;
+  return result;
+}
+
+static struct binding *lookup(struct binding *scope, struct exp *symbol) {
+  for (; scope != NULL; scope = scope->next) {
+    if (scope->symbol == symbol) {
+      return scope;
+    }
+  }
+  return NULL;
+}
+
+static int is_constant(struct exp *exp) {
+  return analyze_self_eval(exp) || exp_list_tagged(exp, KEYWORD(QUOTE));
+}
+
+static struct exp *constant_value(struct exp *exp) {
+  return exp_list_tagged(exp, KEYWORD(QUOTE)) ? CADR(exp) : exp;
+}
+
+static struct exp *make_constant(struct exp *value) {
+  return analyze_self_eval(value) ? value : exp_quote(value);
+}
+
+/* evaluating a pure expression cannot fail or have an effect. */
+/* an internal define may be read before it is set, so it is not. */
+static int is_pure(struct exp *exp, struct binding *scope) {
+  struct binding *binding;
+  if (is_constant(exp) || exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    return 1;
+  }
+  binding = IS(exp, SYMBOL) ? lookup(scope, exp) : NULL;
+  return binding != NULL && !(binding->flags & BINDING_DEFINED);
+}
+
+/* the variables defined directly in a lambda body, as in analyze */
+static struct exp *defines_in(struct exp *exp, struct exp *found) {
+  if (!IS(exp, PAIR) ||
+      exp_list_tagged(exp, KEYWORD(QUOTE)) ||
+      exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    return found;
+  } else if (exp_list_tagged(exp, KEYWORD(DEFINE))) {
+    return defines_in(CADDR(exp), exp_make_pair(CADR(exp), found));
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    found = defines_in(CAR(exp), found);
+  }
+  return found;
+}
+
+/* every variable a lambda or define in exp binds */
+static struct exp *binders(struct exp *exp, struct exp *found) {
+  struct exp *params;
+  if (!IS(exp, PAIR) || exp_list_tagged(exp, KEYWORD(QUOTE))) {
+    return found;
+  } else if (exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    for (params = CADR(exp); IS(params, PAIR); params = CDR(params)) {
+      found = exp_make_pair(CAR(params), found);
+    }
+    if (params != NIL) {
+      found = exp_make_pair(params, found);
+    }
+    return binders(CADDR(exp), found);
+  } else if (exp_list_tagged(exp, KEYWORD(DEFINE))) {
+    return binders(CADDR(exp), exp_make_pair(CADR(exp), found));
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    found = binders(CAR(exp), found);
+  }
+  return found;
+}
+
+static int is_foldable_name(struct exp *symbol);
+
+/* whether exp may call anything but a lambda on the spot or a */
+/* builtin that can be folded, which could go on to redefine one. */
+/* bound holds the variables that may shadow the builtins. */
+static int calls_out(struct exp *exp, struct exp *bound) {
+  struct exp *fn;
+  size_t i;
+  if (!IS(exp, PAIR) || exp_list_tagged(exp, KEYWORD(QUOTE))) {
+    return 0;
+  } else if (exp_list_tagged(exp, KEYWORD(LAMBDA))) {
+    return calls_out(CADDR(exp), bound);
+  }
+  for (i = 0; i < NELEM(tag_map); i += 1) {
+    if (exp_list_tagged(exp, keywords[tag_map[i].tag])) {
+      break;
+    }
+  }
+  fn = CAR(exp);
+  if (i == NELEM(tag_map) && !exp_list_tagged(fn, KEYWORD(LAMBDA)) &&
+      (!IS(fn, SYMBOL) || !is_foldable_name(fn) ||
+       analyze_occurs(fn, bound))) {
+    return 1;
+  }
+  for (; IS(exp, PAIR); exp = CDR(exp)) {
+    if (calls_out(CAR(exp), bound)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static struct exp *reverse(struct exp *list) {
+  struct exp *result = NIL;
+  for (; list != NIL; list = CDR(list)) {
+    result = exp_make_pair(CAR(list), result);
+  }
+  return result;
+}
+
+static struct binding *bind(struct binding *binding, struct exp *symbol,
+                            struct exp *body, struct binding *next) {
+  binding->symbol = symbol;
+  binding->value = NULL;
+  binding->target = NULL;
+  binding->flags = analyze_assigned(symbol, body) ? BINDING_ASSIGNED : 0;
+  binding->next = next;
+  return binding;
+}
+
+/* a variable that is never assigned can be replaced by the */
+/* constant it is bound to, or by another such variable */
+static void propagate(struct binding *binding, struct exp *arg,
+                      struct binding *scope) {
+  struct binding *target;
+  if (binding->flags) {
+    return;
+  } else if (is_constant(arg)) {
+    binding->value = arg;
+  } else if (IS(arg, SYMBOL) &&
+             (target = lookup(scope, arg)) != NULL && !target->flags) {
+    binding->value = arg;
+    binding->target = target;
+  }
+}
+
+/* optimizes a lambda body. args holds the already optimized */
+/* arguments when the lambda is applied on the spot, else NIL. */
+static struct exp *optimize_body(struct exp *params, struct exp *args,
+                                 struct exp *body, struct binding *scope) {
+  struct exp *defines = defines_in(body, NIL);
+  size_t count = exp_list_length(defines);
+  struct exp *rest;
+  for (rest = params; IS(rest, PAIR); rest = CDR(rest)) {
+    count += 1;
+  }
+  if (rest != NIL) {
+    count += 1;
+  }
+  {
+    struct binding vars[count > 0 ? count : 1];
+    struct binding *inner = scope;
+    size_t i = 0;
+    for (rest = params; IS(rest, PAIR); rest = CDR(rest), i += 1) {
+      inner = bind(&vars[i], CAR(rest), body, inner);
+      if (args != NIL) {
+        propagate(inner, CAR(args), scope);
+        args = CDR(args);
+      }
+    }
+    if (rest != NIL) {
+      inner = bind(&vars[i], rest, body, inner);
+      i += 1;
+    }
+    for (; defines != NIL; defines = CDR(defines), i += 1) {
+      inner = bind(&vars[i], CAR(defines), body, inner);
+      inner->flags |= BINDING_ASSIGNED | BINDING_DEFINED;
+    }
+    return optimize_in(body, inner);
+  }
+}
+
+static struct exp *optimize_symbol(struct exp *exp, struct binding *scope) {
+  struct binding *binding = lookup(scope, exp);
+  if (binding != NULL && binding->value != NULL &&
+      (binding->target == NULL ||
+       lookup(scope, binding->value) == binding->target)) {
+    return binding->value;
+  }
+  return exp;
+}
+
+static struct exp *optimize_in(struct exp *exp, struct binding *scope) {
+  if (IS(exp, SYMBOL)) {
+    return optimize_symbol(exp, scope);
+  } else if (IS(exp, PAIR)) {
+    size_t i;
+    for (i = 0; i < NELEM(tag_map); i += 1) {
+      if (exp_list_tagged(exp, keywords[tag_map[i].tag])) {
+        return (*tag_map[i].optimize)(exp, scope);
+      }
+    }
+    return optimize_apply(exp, scope);
+  } else {
+    return exp;
+  }
+}
+
+static struct exp *optimize_quote(struct exp *exp, struct binding *scope) {
+  return exp;
+}
+
+/* set! and define only need their value optimized */
+static struct exp *optimize_set(struct exp *exp, struct binding *scope) {
+  return exp_make_list(CAR(exp), CADR(exp),
+                       optimize_in(CADDR(exp), scope), NULL);
+}
+
+static struct exp *optimize_if(struct exp *exp, struct binding *scope) {
+  struct exp *test = optimize_in(CADR(exp), scope);
+  if (is_constant(test)) {
+    return optimize_in(constant_value(test) != FALSE ?
+                       CADDR(exp) : CADDDR(exp), scope);
+  }
+  return exp_make_list(KEYWORD(IF), test,
+                       optimize_in(CADDR(exp), scope),
+                       optimize_in(CADDDR(exp), scope), NULL);
+}
+
+/* a constant false is skipped, and a constant true ends the or */
+static struct exp *optimize_or_args(struct exp *args, struct binding *scope) {
+  struct exp *arg = optimize_in(CAR(args), scope);
+  if (CDR(args) == NIL ||
+      (is_constant(arg) && constant_value(arg) != FALSE)) {
+    return exp_make_pair(arg, NIL);
+  } else if (is_constant(arg)) {
+    return optimize_or_args(CDR(args), scope);
+  } else {
+    return exp_make_pair(arg, optimize_or_args(CDR(args), scope));
+  }
+}
+
+static struct exp *optimize_or(struct exp *exp, struct binding *scope) {
+  struct exp *args;
+  if (CDR(exp) == NIL) {
+    return exp;
+  }
+  args = optimize_or_args(CDR(exp), scope);
+  return CDR(args) == NIL ? CAR(args) : exp_make_pair(KEYWORD(OR), args);
+}
+
+/* a lambda body runs later, when a builtin may have been */
+/* redefined, so nothing in it is folded */
+static struct exp *optimize_lambda(struct exp *exp, struct binding *scope) {
+  int outer_folding = folding;
+  struct exp *body;
+  folding = 0;
+  body = optimize_body(CADR(exp), NIL, CADDR(exp), scope);
+  folding = outer_folding;
+  return exp_make_list(KEYWORD(LAMBDA), CADR(exp), body, NULL);
+}
+
+/* pure expressions are dropped unless their value is used */
+static struct exp *optimize_sequence(struct exp *exps,
+                                     struct binding *scope) {
+  struct exp *exp = optimize_in(CAR(exps), scope);
+  if (CDR(exps) == NIL) {
+    return exp_make_pair(exp, NIL);
+  } else if (is_pure(exp, scope)) {
+    return optimize_sequence(CDR(exps), scope);
+  } else {
+    return exp_make_pair(exp, optimize_sequence(CDR(exps), scope));
+  }
+}
+
+static struct exp *optimize_begin(struct exp *exp, struct binding *scope) {
+  struct exp *exps;
+  if (CDR(exp) == NIL) {
+    return exp;
+  }
+  exps = optimize_sequence(CDR(exp), scope);
+  return CDR(exps) == NIL ? CAR(exps) : exp_make_pair(KEYWORD(BEGIN), exps);
+}
+
+static int is_foldable_name(struct exp *symbol) {
+  size_t i;
+  for (i = 0; i < NELEM(fold_map); i += 1) {
+    if (!strcmp(fold_map[i].name, symbol->value.symbol)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* a call to a pure builtin on constants is replaced by its result, */
+/* as long as the builtin is not shadowed, redefined, or assigned */
+/* anywhere in the form. the call must not be able to fail. */
+static struct foldable *foldable(struct exp *fn, struct exp *args,
+                                 struct binding *scope) {
+  size_t i;
+  if (!folding || !IS(fn, SYMBOL) || lookup(scope, fn) != NULL) {
+    return NULL;
+  }
+  for (; args != NIL; args = CDR(args)) {
+    if (!is_constant(CAR(args))) {
+      return NULL;
+    }
+  }
+  for (i = 0; i < NELEM(fold_map); i += 1) {
+    if (!strcmp(fold_map[i].name, fn->value.symbol)) {
+      return analyze_assigned(fn, form) ? NULL : &fold_map[i];
+    }
+  }
+  return NULL;
+}
+
+static struct exp *fold(struct exp *fn, struct exp *args,
+                        struct binding *scope) {
+  struct foldable *entry = foldable(fn, args, scope);
+  size_t argc = exp_list_length(args);
+  struct exp *cell;
+  struct exp *value;
+  if (entry == NULL) {
+    return NULL;
+  }
+  cell = env_cell(fn);
+  value = cell->value.cell.value;
+  if (!cell->value.cell.original || value == NULL || !IS(value, FUNCTION) ||
+      !builtin_arity_ok(value, argc)) {
+    return NULL;
+  }
+  {
+    struct exp *argv[argc > 0 ? argc : 1];
+    size_t i;
+    for (i = 0; i < argc; i += 1, args = CDR(args)) {
+      argv[i] = constant_value(CAR(args));
+    }
+    if (!builtin_types_ok(value, argc, argv) ||
+        (entry->divides && argv[1] == exp_make_fixnum(0))) {
+      return NULL;
+    }
+    return make_constant((*value->value.function.fn)(argc, argv));
+  }
+}
+
+/* only a lambda with distinct, fixed parameters that is given the */
+/* right number of arguments is treated like a let */
+static int is_let(struct exp *fn, struct exp *args) {
+  struct exp *params;
+  if (!exp_list_tagged(fn, KEYWORD(LAMBDA))) {
+    return 0;
+  }
+  for (params = CADR(fn); IS(params, PAIR) && args != NIL;
+       params = CDR(params), args = CDR(args)) {
+    if (!IS(CAR(params), SYMBOL) ||
+        analyze_occurs(CAR(params), CDR(params))) {
+      return 0;
+    }
+  }
+  return params == NIL && args == NIL;
+}
+
+/* a parameter that is no longer used is removed along with its */
+/* argument if that is pure. a let left without parameters is */
+/* replaced by its body, unless the body has defines of its own. */
+static struct exp *optimize_let(struct exp *fn, struct exp *args,
+                                struct binding *scope) {
+  struct exp *body = optimize_body(CADR(fn), args, CADDR(fn), scope);
+  struct exp *params = CADR(fn);
+  struct exp *kept_params = NIL;
+  struct exp *kept_args = NIL;
+  for (; params != NIL; params = CDR(params), args = CDR(args)) {
+    if (analyze_occurs(CAR(params), body) || !is_pure(CAR(args), scope)) {
+      kept_params = exp_make_pair(CAR(params), kept_params);
+      kept_args = exp_make_pair(CAR(args), kept_args);
+    }
+  }
+  if (kept_params == NIL && defines_in(body, NIL) == NIL) {
+    return body;
+  }
+  return exp_make_pair(exp_make_list(KEYWORD(LAMBDA), reverse(kept_params),
+                                     body, NULL),
+                       reverse(kept_args));
+}
+
+static struct exp *optimize_apply(struct exp *exp, struct binding *scope) {
+  struct exp *args = exp_list_map(CDR(exp), &map_optimize, scope);
+  struct exp *fn = CAR(exp);
+  struct exp *result;
+  if (is_let(fn, args)) {
+    return optimize_let(fn, args, scope);
+  }
+  fn = optimize_in(fn, scope);
+  result = fold(fn, args, scope);
+  return result != NULL ? result : exp_make_pair(fn, args);
+}
+
+#undef NELEM
+
+static struct exp *map_optimize(struct exp *exp, void *data) {
+  struct binding *scope = data;
+  return optimize_in(exp, scope);
+}
@@ -0,0 +1,4 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+extern struct exp *optimize(struct exp *exp);
+#endif
@@ -4,7 +4,7 @@
 #include "exp.h"
 
 void print(struct exp *exp) {
-  switch (exp->type) {
+  switch (TYPE(exp)) {
   case UNDEFINED:
     break;
   default:
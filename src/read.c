@@ -5,6 +5,7 @@
 
 #include "exp.h"
 #include "err.h"
+#include "symtab.h"
 #include "util/input.h"
 #include "util/strbuf.h"
 #include "util/vector.h"
@@ -95,7 +96,7 @@ static struct exp *read_atom(struct input *input) {
       struct exp *e = exp_make_atom(str);
       free(str);
       strbuf_free(buf);
-      return e;
+      return e != NULL ? e : err_error("read: number out of range", NULL);
     } else {
       strbuf_push(buf, c);
     }
@@ -110,7 +111,7 @@ static struct exp *read_pair(struct input *input) {
   } else {
     unget(input, c);
     struct exp *exp = read(input);
-    if (exp_symbol_eq(exp, ".")) {
+    if (exp == KEYWORD(DOT)) {
       exp = read(input);
       eat_space(input);
       if ((c = get(input)) != ')') {
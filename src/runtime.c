@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "config.h"
+#include "cont.h"
+#include "cstack.h"
+#include "env.h"
+#include "err.h"
+#include "eval.h"
+#include "exp.h"
+#include "gc.h"
+#include "print.h"
+#include "runtime.h"
+#include "symtab.h"
+#include "vm.h"
+#include "util/vector.h"
+
+static const size_t stack_size = 1 << 20;
+
+static struct {
+  struct exp **slots;
+  struct exp **top;
+  struct exp **end;
+} stack;
+
+/* the call a tail call left for the trampoline to make */
+static struct {
+  struct exp *fn;
+  size_t argc;
+  struct exp **argv;
+} pending;
+
+void runtime_init(int argc, char **argv) {
+  config_init(argc, argv);
+  /* compiled code holds on to constants and cells in c arrays, */
+  /* so it needs a collector that never moves anything, and keeps */
+  /* temporaries in c variables, so it only collects between forms */
+  if (gc != &gc_ms) {
+    fprintf(stderr, "compiled programs collect only with --gc=ms\n");
+    exit(1);
+  }
+  gc_safepoints = 0;
+  (*gc->init)();
+  if (config.gc_stats) {
+    atexit(&gc_report);
+  }
+  symtab_init();
+  builtin_defall();
+  stack.slots = malloc(stack_size * sizeof *stack.slots);
+  stack.top = stack.slots;
+  stack.end = stack.slots + stack_size;
+  cstack_init();
+}
+
+/* the only roots are globals, so the constants are kept in one */
+/* under a name the reader cannot produce */
+void runtime_keep(size_t count, struct exp **constants) {
+  struct exp *vector = exp_make_vector(0);
+  size_t i;
+  for (i = 0; i < count; i += 1) {
+    vector_push(vector->value.vector, constants[i]);
+  }
+  env_define(exp_make_symbol("#<constants>"), vector);
+}
+
+struct exp *runtime_string(const char *str) {
+  char *copy = malloc(strlen(str) + 1);
+  strcpy(copy, str);
+  return exp_make_string(copy);
+}
+
+/* compiled lambdas only need what env_bind looks at */
+struct exp *runtime_lambda(struct exp *params, size_t slots) {
+  struct exp *lambda = exp_make_node(NODE_LAMBDA, params, NIL, NIL);
+  lambda->value.node.slot = slots;
+  return lambda;
+}
+
+struct exp *runtime_closure(struct exp *lambda, runtime_fn fn,
+                            struct env *captured) {
+  struct exp *closure = exp_make_closure(lambda, captured);
+  closure->value.closure.native = fn;
+  return closure;
+}
+
+struct exp **runtime_push(size_t count) {
+  struct exp **slots = stack.top;
+  if (count > (size_t)(stack.end - slots)) {
+    err_error("runtime: stack overflow", NULL);
+  }
+  stack.top = slots + count;
+  return slots;
+}
+
+struct exp *runtime_unbound(void) {
+  return err_error("eval: variable used before its definition", NULL);
+}
+
+struct exp *runtime_error(const char *msg) {
+  return err_error(msg, NULL);
+}
+
+/* a closure the evaluators made is called by evaluating an */
+/* application of it, as apply in the stdlib does */
+static struct exp *interpret(struct exp *fn, size_t argc,
+                             struct exp **argv) {
+  struct exp *args = NIL;
+  while (argc > 0) {
+    argc -= 1;
+    args = exp_make_pair(exp_quote(argv[argc]), args);
+  }
+  return eval(exp_make_pair(fn, args));
+}
+
+/* argv is the top of the stack. each procedure's frame starts */
+/* there, and so does the frame of each tail call it makes. */
+struct exp *runtime_call(struct exp *fn, size_t argc, struct exp **argv) {
+  struct exp *value;
+  cstack_check("runtime: stack overflow");
+  for (;;) {
+    switch (TYPE(fn)) {
+    case FUNCTION:
+      value = builtin_apply(fn, argc, argv);
+      break;
+    case CLOSURE:
+      if (fn->value.closure.native != NULL) {
+        struct exp *lambda = fn->value.closure.lambda;
+        size_t slots = lambda->value.node.slot;
+        stack.top = argv;
+        runtime_push(argc > slots ? argc : slots);
+        env_bind(lambda, argc, argv);
+        value = (*fn->value.closure.native)(argv, fn->value.closure.env);
+      } else {
+        value = interpret(fn, argc, argv);
+      }
+      break;
+    case CONTINUATION:
+      return cont_throw(fn, argc, argv);
+    default:
+      return err_error("eval: bad function type",
+                       exp_make_pair(fn, exp_list_from(argc, argv)));
+    }
+    if (value != NULL) {
+      break;
+    }
+    fn = pending.fn;
+    argc = pending.argc;
+    memmove(argv, pending.argv, argc * sizeof *argv);
+  }
+  stack.top = argv;
+  return value;
+}
+
+struct exp *runtime_tail(struct exp *fn, size_t argc, struct exp **argv) {
+  pending.fn = fn;
+  pending.argc = argc;
+  pending.argv = argv;
+  return NULL;
+}
+
+struct exp *runtime_apply(struct exp *fn, size_t argc, struct exp **argv) {
+  struct exp **slots = runtime_push(argc);
+  memcpy(slots, argv, argc * sizeof *argv);
+  return runtime_call(fn, argc, slots);
+}
+
+void runtime_toplevel(runtime_fn fn) {
+  if (!err_init()) {
+    struct exp *value = (*fn)(NULL, NULL);
+    if (value == NULL) {
+      value = runtime_call(pending.fn, pending.argc, pending.argv);
+    }
+    if (!config.silent) {
+      print(value);
+    }
+  } else {
+    char *msg = err_message();
+    printf("error: %s\n", msg);
+    free(msg);
+    vm_reset();
+    eval_reset();
+    cont_reset();
+  }
+  stack.top = stack.slots;
+  /* between forms is a safe point, even where calls are not */
+  if (gc_wanted) {
+    gc_pause();
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+#include <stddef.h>
+
+#include "env.h"
+#include "exp.h"
+#include "gc.h"
+
+/* support for programs compiled to c by aot.c. every lambda */
+/* becomes a c function of its frame and the values it captured, */
+/* and so does each top-level form, with neither. frames live on */
+/* a stack of the runtime's own, like the evaluators' do. */
+typedef struct exp *(*runtime_fn)(struct exp **locals,
+                                  struct env *captured);
+
+extern void runtime_init(int argc, char **argv);
+/* keeps the constants of a program alive across collections */
+extern void runtime_keep(size_t count, struct exp **constants);
+extern struct exp *runtime_string(const char *str);
+extern struct exp *runtime_lambda(struct exp *params, size_t slots);
+extern struct exp *runtime_closure(struct exp *lambda, runtime_fn fn,
+                                   struct env *captured);
+/* runs a top-level form, printing its value or error as the */
+/* interpreter would */
+extern void runtime_toplevel(runtime_fn fn);
+
+/* a call pushes its arguments and then calls or tail calls. a */
+/* tail call returns NULL to the trampoline in runtime_call, which */
+/* makes the call in place of the one that returned. */
+extern struct exp **runtime_push(size_t count);
+extern struct exp *runtime_call(struct exp *fn, size_t argc,
+                                struct exp **argv);
+extern struct exp *runtime_tail(struct exp *fn, size_t argc,
+                                struct exp **argv);
+/* how the evaluators call a compiled closure */
+extern struct exp *runtime_apply(struct exp *fn, size_t argc,
+                                 struct exp **argv);
+extern struct exp *runtime_unbound(void);
+extern struct exp *runtime_error(const char *msg);
+
+/* a local is NULL until its define has run */
+#define RUNTIME_BOUND(v) ((v) != NULL ? (v) : runtime_unbound())
+#define RUNTIME_GLOBAL(c)                                       \
+  ((c)->value.cell.value != NULL ?                              \
+   (c)->value.cell.value : env_cell_value(c))
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "exp.h"
+#include "gc.h"
+#include "symtab.h"
+
+struct exp *keywords[KEYWORD_COUNT];
+
+#define SYMTAB_NAME(name, str) str,
+static const char *keyword_names[] = { SYMTAB_KEYWORDS(SYMTAB_NAME) };
+#undef SYMTAB_NAME
+
+/* open addressing with linear probing. capacity is a power of two */
+/* and the table is grown to stay at most half full. */
+static struct {
+  struct exp **slots;
+  size_t capacity;
+  size_t count;
+} symtab;
+
+static const size_t symtab_min_capacity = 256;
+
+/* fnv-1a */
+size_t symtab_hash(const char *name) {
+  size_t h = 2166136261u;
+  for (; *name != '\0'; name += 1) {
+    h ^= (unsigned char)*name;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void insert(struct exp **slots, size_t capacity, struct exp *symbol) {
+  size_t i = symtab_hash(symbol->value.symbol) & (capacity - 1);
+  while (slots[i] != NULL) {
+    i = (i + 1) & (capacity - 1);
+  }
+  slots[i] = symbol;
+}
+
+/* rebuilds the table at a new capacity, dropping dead symbols */
+static void rehash(size_t capacity, struct exp *(*alive)(struct exp *symbol)) {
+  struct exp **slots = calloc(capacity, sizeof *slots);
+  size_t i;
+  symtab.count = 0;
+  for (i = 0; i < symtab.capacity; i += 1) {
+    struct exp *symbol = symtab.slots[i];
+    if (symbol != NULL && alive != NULL) {
+      symbol = (*alive)(symbol);
+    }
+    if (symbol != NULL) {
+      insert(slots, capacity, symbol);
+      symtab.count += 1;
+    }
+  }
+  free(symtab.slots);
+  symtab.slots = slots;
+  symtab.capacity = capacity;
+}
+
+void symtab_init(void) {
+  size_t i;
+  rehash(symtab_min_capacity, NULL);
+  for (i = 0; i < KEYWORD_COUNT; i += 1) {
+    keywords[i] = symtab_intern(keyword_names[i]);
+  }
+}
+
+struct exp *symtab_intern(const char *name) {
+  size_t i = symtab_hash(name) & (symtab.capacity - 1);
+  struct exp *symbol;
+  for (; symtab.slots[i] != NULL; i = (i + 1) & (symtab.capacity - 1)) {
+    if (!strcmp(symtab.slots[i]->value.symbol, name)) {
+      return symtab.slots[i];
+    }
+  }
+  symbol = (*gc->alloc_exp)(SYMBOL);
+  symbol->value.symbol = malloc(strlen(name) + 1);
+  strcpy(symbol->value.symbol, name);
+  symtab.slots[i] = symbol;
+  symtab.count += 1;
+  if (symtab.count * 2 > symtab.capacity) {
+    rehash(symtab.capacity * 2, NULL);
+  }
+  return symbol;
+}
+
+void symtab_sweep(struct exp *(*alive)(struct exp *symbol)) {
+  size_t capacity = symtab.capacity;
+  rehash(capacity, alive);
+  /* shrink when a sweep leaves the table mostly empty */
+  while (capacity > symtab_min_capacity && symtab.count * 8 < capacity) {
+    capacity /= 2;
+  }
+  if (capacity != symtab.capacity) {
+    rehash(capacity, NULL);
+  }
+}
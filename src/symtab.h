@@ -0,0 +1,42 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+#include "exp.h"
+
+/* every symbol is interned, so there is exactly one exp per name */
+/* and symbols can be compared with ==. the table is weak: it does */
+/* not keep its symbols alive, and each collection sweeps it. */
+
+#define SYMTAB_KEYWORDS(X)                      \
+  X(QUOTE, "quote")                             \
+  X(QUASIQUOTE, "quasiquote")                   \
+  X(UNQUOTE, "unquote")                         \
+  X(UNQUOTE_SPLICING, "unquote-splicing")       \
+  X(SET, "set!")                                \
+  X(DEFINE, "define")                           \
+  X(IF, "if")                                   \
+  X(LAMBDA, "lambda")                           \
+  X(BEGIN, "begin")                             \
+  X(COND, "cond")                               \
+  X(ELSE, "else")                               \
+  X(AND, "and")                                 \
+  X(OR, "or")                                   \
+  X(DOT, ".")
+
+#define SYMTAB_ENUM(name, str) KEYWORD_##name,
+enum keyword {
+  SYMTAB_KEYWORDS(SYMTAB_ENUM)
+  KEYWORD_COUNT
+};
+#undef SYMTAB_ENUM
+
+/* keywords are roots, so they are never collected */
+extern struct exp *keywords[KEYWORD_COUNT];
+#define KEYWORD(name) (keywords[KEYWORD_##name])
+
+extern void symtab_init(void);
+extern struct exp *symtab_intern(const char *name);
+extern size_t symtab_hash(const char *name);
+/* alive returns where a symbol lives after a collection, */
+/* or NULL if it is garbage */
+extern void symtab_sweep(struct exp *(*alive)(struct exp *symbol));
+#endif
@@ -0,0 +1,141 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "deque.h"
+
+/* gcc's atomics order what the threads see of each other. other */
+/* compilers get plain loads and stores, good for one thread. */
+#ifdef __GNUC__
+#define LOAD(p, order) __atomic_load_n(p, __ATOMIC_##order)
+#define STORE(p, v, order) __atomic_store_n(p, v, __ATOMIC_##order)
+#define FENCE(order) __atomic_thread_fence(__ATOMIC_##order)
+#define CAS(p, e, v)                                                    \
+  __atomic_compare_exchange_n(p, e, v, 0, __ATOMIC_SEQ_CST,             \
+                              __ATOMIC_RELAXED)
+#else
+#define LOAD(p, order) (*(p))
+#define STORE(p, v, order) (*(p) = (v))
+#define FENCE(order) ((void)0)
+#define CAS(p, e, v) (*(p) == *(e) ? (*(p) = (v), 1) : (*(e) = *(p), 0))
+#endif
+
+/* a ring is replaced by one twice its size when it fills, but kept */
+/* until the deque is freed, since a thief may still be reading it */
+struct ring {
+  long size;
+  struct ring *prev;
+  void *items[];
+};
+
+struct deque {
+  long top;
+  long bottom;
+  struct ring *ring;
+};
+
+/* the collector's markers grow these while marking, when there is */
+/* no error to unwind to, so running out of memory is fatal */
+static struct ring *ring_new(long size, struct ring *prev) {
+  struct ring *r = malloc(sizeof *r + size * sizeof *r->items);
+  if (r == NULL) {
+    fprintf(stderr, "gc: out of memory\n");
+    exit(1);
+  }
+  r->size = size;
+  r->prev = prev;
+  return r;
+}
+
+struct deque *deque_new(void) {
+  struct deque *d = calloc(1, sizeof *d);
+  if (d == NULL) {
+    fprintf(stderr, "gc: out of memory\n");
+    exit(1);
+  }
+  d->ring = ring_new(64, NULL);
+  return d;
+}
+
+void deque_free(struct deque **dp) {
+  struct ring *r;
+  assert(*dp);
+  r = (*dp)->ring;
+  while (r != NULL) {
+    struct ring *prev = r->prev;
+    free(r);
+    r = prev;
+  }
+  free(*dp);
+  *dp = NULL;
+}
+
+int deque_empty(struct deque *d) {
+  return LOAD(&d->top, ACQUIRE) >= LOAD(&d->bottom, ACQUIRE);
+}
+
+static struct ring *deque_grow(struct deque *d, struct ring *r,
+                               long top, long bottom) {
+  struct ring *bigger = ring_new(2 * r->size, r);
+  long i;
+  for (i = top; i < bottom; i += 1) {
+    bigger->items[i & (bigger->size - 1)] = r->items[i & (r->size - 1)];
+  }
+  STORE(&d->ring, bigger, RELEASE);
+  return bigger;
+}
+
+void deque_push(struct deque *d, void *item) {
+  long bottom = LOAD(&d->bottom, RELAXED);
+  long top = LOAD(&d->top, ACQUIRE);
+  struct ring *r = LOAD(&d->ring, RELAXED);
+  if (bottom - top >= r->size) {
+    r = deque_grow(d, r, top, bottom);
+  }
+  STORE(&r->items[bottom & (r->size - 1)], item, RELAXED);
+  FENCE(RELEASE);
+  STORE(&d->bottom, bottom + 1, RELAXED);
+}
+
+void *deque_pop(struct deque *d) {
+  long bottom = LOAD(&d->bottom, RELAXED) - 1;
+  struct ring *r = LOAD(&d->ring, RELAXED);
+  long top;
+  void *item;
+  STORE(&d->bottom, bottom, RELAXED);
+  FENCE(SEQ_CST);
+  top = LOAD(&d->top, RELAXED);
+  if (top > bottom) {
+    STORE(&d->bottom, bottom + 1, RELAXED);
+    return NULL;
+  }
+  item = LOAD(&r->items[bottom & (r->size - 1)], RELAXED);
+  if (top == bottom) {
+    /* the last item, which a thief may be taking too */
+    if (!CAS(&d->top, &top, top + 1)) {
+      item = NULL;
+    }
+    STORE(&d->bottom, bottom + 1, RELAXED);
+  }
+  return item;
+}
+
+void *deque_steal(struct deque *d) {
+  long top = LOAD(&d->top, ACQUIRE);
+  long bottom;
+  FENCE(SEQ_CST);
+  bottom = LOAD(&d->bottom, ACQUIRE);
+  if (top < bottom) {
+    struct ring *r = LOAD(&d->ring, ACQUIRE);
+    void *item = LOAD(&r->items[top & (r->size - 1)], RELAXED);
+    if (CAS(&d->top, &top, top + 1)) {
+      return item;
+    }
+  }
+  return NULL;
+}
+
+#undef LOAD
+#undef STORE
+#undef FENCE
+#undef CAS
@@ -0,0 +1,13 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+/* a work stealing deque, after chase and lev: its owner pushes and */
+/* pops at the bottom while other threads steal from the top. items */
+/* may not be NULL, which pop and steal return when there are none. */
+extern struct deque *deque_new(void);
+extern void deque_free(struct deque **dp);
+extern int deque_empty(struct deque *d);
+extern void deque_push(struct deque *d, void *item);
+extern void *deque_pop(struct deque *d);
+/* may also return NULL on losing a race for the last item */
+extern void *deque_steal(struct deque *d);
+#endif
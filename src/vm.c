@@ -0,0 +1,831 @@
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "config.h"
+#include "cont.h"
+#include "env.h"
+#include "err.h"
+#include "exp.h"
+#include "gc.h"
+#include "jit.h"
+#include "runtime.h"
+#include "vm.h"
+#include "util/vector.h"
+
+/* computed goto is a gnu extension. other compilers get a switch. */
+#ifdef __GNUC__
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define THREADED 1
+#else
+#define THREADED 0
+#endif
+
+/* a call's frame is the block of stack slots where its arguments */
+/* were pushed, extended to hold the rest of its locals. base is */
+/* the slot of the operator just below, which the result replaces. */
+/* escape is the call/ec continuation that returns from the frame. */
+struct frame {
+  struct exp *code;
+  unsigned int *pc;
+  struct exp **locals;
+  struct env *captured;
+  struct exp **base;
+  struct exp *escape;
+};
+
+/* each vm_run is an activation, with its own frames and stack */
+/* above those of the one it is nested in. a continuation copies */
+/* or marks only the frames of its own activation, so it can only */
+/* be resumed there, or if it was made at top level, in any later */
+/* top-level activation. the stacks can move, so it keeps where */
+/* its frames and stack start as indexes. code and captured are */
+/* what it was running when it last called out, for the collector. */
+struct activation {
+  unsigned long id;
+  size_t level;
+  size_t entry;
+  size_t stack;
+  jmp_buf jmp;
+  struct exp *code;
+  struct env *captured;
+  struct activation *outer;
+};
+
+/* the stacks start small and double when they fill up, so only */
+/* memory limits how deep calls go */
+static const size_t stack_size = 1 << 14;
+static const size_t stack_max = 1 << 24;
+static const size_t frames_size = 1 << 10;
+static const size_t frames_max = 1 << 22;
+
+static struct {
+  struct exp **stack;
+  struct exp **sp;
+  struct exp **end;
+  struct frame *frames;
+  struct frame *fp;
+  struct frame *frames_end;
+  struct activation *active;
+  unsigned long runs;
+  /* what a longjmp to an activation resumes, with what value */
+  struct exp *thrown;
+  struct exp *value;
+} vm;
+
+static void vm_init(void) {
+  vm.stack = malloc(stack_size * sizeof *vm.stack);
+  vm.sp = vm.stack;
+  vm.end = vm.stack + stack_size;
+  vm.frames = malloc(frames_size * sizeof *vm.frames);
+  vm.fp = vm.frames;
+  vm.frames_end = vm.frames + frames_size;
+}
+
+/* where p, which pointed into the stack at old, is now */
+#define MOVED(p, old)                                                   \
+  (vm.stack + ((uintptr_t)(p) - (uintptr_t)(old)) / sizeof *vm.stack)
+
+/* makes room for count slots above sp. if the stack moves, the */
+/* frames move with it, and vm_run moves its own registers. */
+static void grow_stack(struct exp **sp, size_t count) {
+  struct exp **old = vm.stack;
+  struct exp **stack;
+  size_t used = sp - vm.stack;
+  size_t size = vm.end - vm.stack;
+  struct frame *f;
+  while (size - used < count) {
+    size *= 2;
+  }
+  if (size > stack_max || (stack = realloc(old, size * sizeof *stack)) == NULL) {
+    err_error("vm: stack overflow", NULL);
+  }
+  vm.stack = stack;
+  vm.end = stack + size;
+  if (stack != old) {
+    vm.sp = MOVED(vm.sp, old);
+    for (f = vm.frames; f < vm.fp; f += 1) {
+      if (f->locals != NULL) {
+        f->locals = MOVED(f->locals, old);
+      }
+      f->base = MOVED(f->base, old);
+    }
+  }
+}
+
+static void grow_frames(void) {
+  size_t used = vm.fp - vm.frames;
+  size_t size = 2 * used;
+  struct frame *frames;
+  if (size > frames_max ||
+      (frames = realloc(vm.frames, size * sizeof *frames)) == NULL) {
+    err_error("vm: stack overflow", NULL);
+  }
+  vm.frames = frames;
+  vm.fp = frames + used;
+  vm.frames_end = frames + size;
+}
+
+void vm_reset(void) {
+  vm.sp = vm.stack;
+  vm.fp = vm.frames;
+  vm.active = NULL;
+}
+
+void vm_save(struct vm_state *state) {
+  state->sp = vm.stack != NULL ? (size_t)(vm.sp - vm.stack) : 0;
+  state->fp = vm.stack != NULL ? (size_t)(vm.fp - vm.frames) : 0;
+  state->active = vm.active;
+}
+
+void vm_restore(struct vm_state *state) {
+  if (vm.stack != NULL) {
+    vm.sp = vm.stack + state->sp;
+    vm.fp = vm.frames + state->fp;
+  }
+  vm.active = state->active;
+}
+
+void vm_roots(void (*exp)(struct exp **), void (*env)(struct env **)) {
+  struct exp **slot;
+  struct frame *f;
+  struct activation *a;
+  if (vm.stack == NULL) {
+    return;
+  }
+  for (slot = vm.stack; slot < vm.sp; slot += 1) {
+    if (*slot != NULL) {
+      (*exp)(slot);
+    }
+  }
+  for (f = vm.frames; f < vm.fp; f += 1) {
+    (*exp)(&f->code);
+    if (f->captured != NULL) {
+      (*env)(&f->captured);
+    }
+    if (f->escape != NULL) {
+      (*exp)(&f->escape);
+    }
+  }
+  for (a = vm.active; a != NULL; a = a->outer) {
+    (*exp)(&a->code);
+    if (a->captured != NULL) {
+      (*env)(&a->captured);
+    }
+  }
+}
+
+static void save_frame(struct cont_frame *to, struct frame *from) {
+  to->code = from->code;
+  to->pc = from->pc - from->code->value.proto->code;
+  to->locals = from->locals != NULL ?
+    (size_t)(from->locals - vm.stack) : CONT_NONE;
+  to->captured = from->captured;
+  to->base = from->base - vm.stack;
+  to->escape = from->escape;
+}
+
+static void load_frame(struct frame *to, struct cont_frame *from) {
+  to->code = from->code;
+  to->pc = from->code->value.proto->code + from->pc;
+  to->locals = from->locals != CONT_NONE ? vm.stack + from->locals : NULL;
+  to->captured = from->captured;
+  to->base = vm.stack + from->base;
+  to->escape = from->escape;
+}
+
+/* the continuation of a call/cc in activation a whose value goes */
+/* to base. top is the frame of the running procedure, unless the */
+/* call was in tail position and returns from it instead. */
+static struct exp *copy(struct activation *a, struct frame *top,
+                        struct exp **base) {
+  struct exp *k = cont_new(CONT_COPY);
+  struct cont *c = k->value.cont;
+  size_t count = vm.fp - (vm.frames + a->entry);
+  size_t i;
+  c->run = a->id;
+  c->level = a->level;
+  c->base = base - vm.stack;
+  c->frame = a->entry;
+  c->nframes = count + (top != NULL);
+  c->frames = malloc(c->nframes * sizeof *c->frames);
+  for (i = 0; i < count; i += 1) {
+    save_frame(&c->frames[i], &vm.frames[a->entry + i]);
+  }
+  if (top != NULL) {
+    save_frame(&c->frames[count], top);
+  }
+  c->slot = a->stack;
+  c->nslots = c->base - a->stack;
+  c->slots = malloc(c->nslots * sizeof *c->slots);
+  memcpy(c->slots, vm.stack + a->stack, c->nslots * sizeof *c->slots);
+  return k;
+}
+
+/* the live activation a continuation resumes in, or NULL if */
+/* there is none, or it is an escape whose frame has returned */
+static struct activation *target(struct exp *k) {
+  struct cont *c = k->value.cont;
+  struct activation *a;
+  if (c->type == CONT_MARK &&
+      (c->frame > (size_t)(vm.fp - vm.frames) ||
+       vm.frames[c->frame - 1].escape != k)) {
+    return NULL;
+  }
+  for (a = vm.active; a != NULL; a = a->outer) {
+    if (a->id == c->run ||
+        (c->type == CONT_COPY && c->level == 0 && a->level == 0 &&
+         a->entry == c->frame && a->stack == c->slot)) {
+      return a;
+    }
+  }
+  return NULL;
+}
+
+struct exp *vm_throw(struct exp *k, struct exp *value) {
+  struct activation *a = target(k);
+  if (a == NULL) {
+    return err_error(k->value.cont->type == CONT_MARK ?
+                     "continuation: escape from a call that returned" :
+                     "continuation: resumed outside its evaluation", NULL);
+  }
+  vm.thrown = k;
+  vm.value = value;
+  longjmp(a->jmp, 1);
+}
+
+/* locals are the frame of the running procedure and captured */
+/* holds the free variables of its closure */
+#define VARIABLE(slots, arg)                                    \
+  ((arg) & VM_BOXED ?                                           \
+   &(slots)[VM_SLOT(arg)]->value.cell.value :                   \
+   &(slots)[VM_SLOT(arg)])
+
+/* a store into a box is a store into an exp, see GC_WRITE */
+#define ASSIGN(slots, arg, v)                                   \
+  do {                                                          \
+    if ((arg) & VM_BOXED) {                                     \
+      GC_WRITE((slots)[VM_SLOT(arg)]);                          \
+    }                                                           \
+    *VARIABLE(slots, arg) = (v);                                \
+  } while (0)
+
+#define LOAD(c)                                 \
+  do {                                          \
+    code = (c);                                 \
+    pc = code->value.proto->code;               \
+    consts = code->value.proto->consts;         \
+  } while (0)
+
+/* runs native code for the current proto, if it has any, from */
+/* pc up to the first instruction it leaves to the vm */
+#define NATIVE()                                                        \
+  do {                                                                  \
+    struct proto *p = code->value.proto;                                \
+    if (p->native != NULL) {                                            \
+      pc = p->code + jit_run(p, &sp, locals, captured, pc - p->code);   \
+    }                                                                   \
+  } while (0)
+
+/* a builtin can run the vm again, and so the collector, which */
+/* needs to see everything this activation holds. a collector */
+/* that moves things updates what it sees, and UNSPILL takes the */
+/* new addresses back. */
+#define SPILL()                                 \
+  do {                                          \
+    vm.sp = sp;                                 \
+    run.code = code;                            \
+    run.captured = captured;                    \
+  } while (0)
+
+#define UNSPILL()                               \
+  do {                                          \
+    code = run.code;                            \
+    captured = run.captured;                    \
+  } while (0)
+
+/* the stack moves when it grows, or under a builtin that runs the */
+/* vm again, and the registers that point into it move with it */
+#define REBASE()                                                        \
+  do {                                                                  \
+    if (vm.stack != stack) {                                            \
+      sp = MOVED(sp, stack);                                            \
+      base = MOVED(base, stack);                                        \
+      if (locals != NULL) {                                             \
+        locals = MOVED(locals, stack);                                  \
+      }                                                                 \
+      stack = vm.stack;                                                 \
+    }                                                                   \
+  } while (0)
+
+/* every proto knows its own peak stack use, so room is checked */
+/* once on entry. the extra slot covers a PRIM falling back to a */
+/* generic call, which needs the operator on the stack. */
+#define ENSURE_ROOM(c)                                                  \
+  do {                                                                  \
+    size_t room = (c)->value.proto->max_stack + 1;                      \
+    if ((size_t)(vm.end - sp) < room) {                                 \
+      grow_stack(sp, room);                                             \
+      REBASE();                                                         \
+    }                                                                   \
+  } while (0)
+
+struct exp *vm_run(struct exp *code) {
+  struct exp **locals = NULL;
+  struct env *captured = NULL;
+  size_t entry;
+  struct exp **stack;
+  struct exp **base;
+  struct exp **sp;
+  struct exp **consts;
+  unsigned int *pc;
+  unsigned int w;
+  struct exp *fn;
+  struct exp *value;
+  struct exp *k;
+  /* the call/ec continuation the next frame pushed returns from */
+  struct exp *mark = NULL;
+  struct activation run;
+  size_t argc;
+  int tail;
+  if (vm.stack == NULL) {
+    vm_init();
+  }
+  entry = vm.fp - vm.frames;
+  stack = vm.stack;
+  sp = base = vm.sp;
+  ENSURE_ROOM(code);
+  LOAD(code);
+  run.id = ++vm.runs;
+  run.level = vm.active != NULL ? vm.active->level + 1 : 0;
+  run.entry = entry;
+  run.stack = base - vm.stack;
+  run.code = code;
+  run.captured = NULL;
+  run.outer = vm.active;
+  vm.active = &run;
+  if (setjmp(run.jmp) != 0) {
+    /* a continuation of this activation was called from further */
+    /* in, and everything nested since is gone */
+    vm.active = &run;
+    stack = vm.stack;
+    mark = NULL;
+    k = vm.thrown;
+    value = vm.value;
+    goto resume;
+  }
+#if THREADED
+#define VM_LABEL(op) &&op_##op,
+  static void *labels[] = { VM_OPCODES(VM_LABEL) };
+#undef VM_LABEL
+#define CASE(op) op_##op
+#define NEXT()                                  \
+  do {                                          \
+    w = *pc++;                                  \
+    goto *labels[VM_OP(w)];                     \
+  } while (0)
+  NEXT();
+  {
+#else
+#define CASE(op) case OP_##op
+#define NEXT() continue
+  for (;;) {
+    w = *pc++;
+    switch (VM_OP(w)) {
+#endif
+    CASE(CONST):
+      *sp++ = consts[VM_ARG(w)];
+      NEXT();
+    CASE(LOCAL):
+      value = *VARIABLE(locals, VM_ARG(w));
+      if (value == NULL) {
+        vm.sp = sp;
+        err_error("eval: variable used before its definition", NULL);
+      }
+      *sp++ = value;
+      NEXT();
+    CASE(FREE):
+      value = *VARIABLE(captured->slots, VM_ARG(w));
+      if (value == NULL) {
+        vm.sp = sp;
+        err_error("eval: variable used before its definition", NULL);
+      }
+      *sp++ = value;
+      NEXT();
+    CASE(GLOBAL):
+      value = consts[VM_ARG(w)]->value.cell.value;
+      if (value == NULL) {
+        vm.sp = sp;
+        env_cell_value(consts[VM_ARG(w)]);
+      }
+      *sp++ = value;
+      NEXT();
+    CASE(SET_LOCAL):
+      ASSIGN(locals, VM_ARG(w), sp[-1]);
+      sp[-1] = OK;
+      NEXT();
+    CASE(SET_FREE):
+      ASSIGN(captured->slots, VM_ARG(w), sp[-1]);
+      sp[-1] = OK;
+      NEXT();
+    CASE(SET_GLOBAL):
+      if (consts[VM_ARG(w)]->value.cell.value == NULL) {
+        vm.sp = sp;
+        env_cell_value(consts[VM_ARG(w)]);
+      }
+      ENV_CELL_SET(consts[VM_ARG(w)], sp[-1]);
+      sp[-1] = OK;
+      NEXT();
+    CASE(DEFINE_LOCAL):
+      exp_name(sp[-1], consts[*pc++]);
+      ASSIGN(locals, VM_ARG(w), sp[-1]);
+      sp[-1] = OK;
+      NEXT();
+    CASE(DEFINE_GLOBAL):
+      exp_name(sp[-1], consts[VM_ARG(w)]->value.cell.symbol);
+      ENV_CELL_SET(consts[VM_ARG(w)], sp[-1]);
+      sp[-1] = OK;
+      NEXT();
+    CASE(BOX):
+      locals[VM_ARG(w)] = env_box(locals[VM_ARG(w)]);
+      NEXT();
+    CASE(POP):
+      sp -= 1;
+      NEXT();
+    CASE(JUMP):
+      pc = code->value.proto->code + VM_ARG(w);
+      NEXT();
+    CASE(JUMP_IF_FALSE):
+      sp -= 1;
+      if (*sp == FALSE) {
+        pc = code->value.proto->code + VM_ARG(w);
+      }
+      NEXT();
+    CASE(JUMP_IF_TRUE):
+      if (sp[-1] != FALSE) {
+        pc = code->value.proto->code + VM_ARG(w);
+      } else {
+        sp -= 1;
+      }
+      NEXT();
+    CASE(CLOSURE):
+      {
+        struct env *values = NULL;
+        argc = VM_ARG(w);
+        if (argc > 0) {
+          values = env_new(argc);
+          sp -= argc;
+          memcpy(values->slots, sp, argc * sizeof *sp);
+        }
+        *sp++ = exp_make_closure(consts[*pc++], values);
+      }
+      NEXT();
+    CASE(CALL):
+      argc = VM_ARG(w);
+      tail = 0;
+      goto call;
+    CASE(TAIL_CALL):
+      argc = VM_ARG(w);
+      tail = 1;
+      goto call;
+    CASE(PRIM):
+      argc = VM_ARG(w);
+      tail = 0;
+      goto prim;
+    CASE(TAIL_PRIM):
+      argc = VM_ARG(w);
+      tail = 1;
+      goto prim;
+    CASE(RETURN):
+      value = sp[-1];
+      goto ret;
+
+      /* each open-coded builtin handles the common case inline and */
+      /* leaves anything else, including errors, to a generic call */
+#define FALLBACK(n)                             \
+      do {                                      \
+        argc = (n);                             \
+        goto open_fallback;                     \
+      } while (0)
+#define GUARD(n)                                        \
+      do {                                              \
+        if (!consts[VM_ARG(w)]->value.cell.original) {  \
+          FALLBACK(n);                                  \
+        }                                               \
+      } while (0)
+    CASE(ADD):
+      GUARD(2);
+      if (!IS(sp[-2], FIXNUM) || !IS(sp[-1], FIXNUM)) {
+        FALLBACK(2);
+      }
+      sp[-2] = exp_make_fixnum(FIXNUM_VALUE(sp[-2]) + FIXNUM_VALUE(sp[-1]));
+      sp -= 1;
+      NEXT();
+    CASE(SUB):
+      GUARD(2);
+      if (!IS(sp[-2], FIXNUM) || !IS(sp[-1], FIXNUM)) {
+        FALLBACK(2);
+      }
+      sp[-2] = exp_make_fixnum(FIXNUM_VALUE(sp[-2]) - FIXNUM_VALUE(sp[-1]));
+      sp -= 1;
+      NEXT();
+    CASE(NUM_EQ):
+      GUARD(2);
+      if (!IS(sp[-2], FIXNUM) || !IS(sp[-1], FIXNUM)) {
+        FALLBACK(2);
+      }
+      sp[-2] = sp[-2] == sp[-1] ? TRUE : FALSE;
+      sp -= 1;
+      NEXT();
+    CASE(GT):
+      GUARD(2);
+      if (!IS(sp[-2], FIXNUM) || !IS(sp[-1], FIXNUM)) {
+        FALLBACK(2);
+      }
+      sp[-2] = FIXNUM_VALUE(sp[-2]) > FIXNUM_VALUE(sp[-1]) ? TRUE : FALSE;
+      sp -= 1;
+      NEXT();
+    CASE(CONS):
+      GUARD(2);
+      sp[-2] = exp_make_pair(sp[-2], sp[-1]);
+      sp -= 1;
+      NEXT();
+    CASE(CAR):
+      GUARD(1);
+      if (!IS(sp[-1], PAIR)) {
+        FALLBACK(1);
+      }
+      sp[-1] = CAR(sp[-1]);
+      NEXT();
+    CASE(CDR):
+      GUARD(1);
+      if (!IS(sp[-1], PAIR)) {
+        FALLBACK(1);
+      }
+      sp[-1] = CDR(sp[-1]);
+      NEXT();
+    CASE(EQ):
+      GUARD(2);
+      sp[-2] = sp[-2] == sp[-1] ? TRUE : FALSE;
+      sp -= 1;
+      NEXT();
+    CASE(VECTOR_REF):
+      GUARD(2);
+      if (!IS(sp[-2], VECTOR) || !IS(sp[-1], FIXNUM) ||
+          FIXNUM_VALUE(sp[-1]) < 0 ||
+          FIXNUM_VALUE(sp[-1]) >= vector_length(sp[-2]->value.vector)) {
+        FALLBACK(2);
+      }
+      sp[-2] = vector_get(sp[-2]->value.vector, FIXNUM_VALUE(sp[-1]));
+      sp -= 1;
+      NEXT();
+    CASE(VECTOR_SET):
+      GUARD(3);
+      if (!IS(sp[-3], VECTOR) || !IS(sp[-2], FIXNUM) ||
+          FIXNUM_VALUE(sp[-2]) < 0 ||
+          FIXNUM_VALUE(sp[-2]) >= vector_length(sp[-3]->value.vector)) {
+        FALLBACK(3);
+      }
+      GC_WRITE(sp[-3]);
+      vector_put(sp[-3]->value.vector, FIXNUM_VALUE(sp[-2]), sp[-1]);
+      sp[-3] = OK;
+      sp -= 2;
+      NEXT();
+#undef GUARD
+#undef FALLBACK
+
+    open_fallback:
+      vm.sp = sp;
+      fn = env_cell_value(consts[VM_ARG(w)]);
+      tail = 0;
+      goto generic;
+
+    prim:
+      fn = consts[*pc++]->value.cell.value;
+      if (IS(fn, FUNCTION)) {
+        /* the compiler already checked the arity */
+        SPILL();
+        builtin_check_types(fn, argc, sp - argc);
+        value = (*fn->value.function.fn)(argc, sp - argc);
+        REBASE();
+        UNSPILL();
+        sp -= argc;
+        if (tail) {
+          goto ret;
+        }
+        *sp++ = value;
+        NEXT();
+      }
+      /* the builtin was redefined since this code was compiled */
+    generic:
+      memmove(sp - argc + 1, sp - argc, argc * sizeof *sp);
+      sp[-argc] = fn;
+      sp += 1;
+      goto call;
+
+    call:
+      fn = sp[-argc - 1];
+      switch (TYPE(fn)) {
+      case FUNCTION:
+        if (fn->value.function.fn == &cont_call_cc ||
+            fn->value.function.fn == &cont_call_ec) {
+          goto control;
+        }
+        SPILL();
+        value = builtin_apply(fn, argc, sp - argc);
+        REBASE();
+        UNSPILL();
+        sp -= argc + 1;
+        if (tail) {
+          goto ret;
+        }
+        *sp++ = value;
+        NEXT();
+      case CLOSURE:
+        if (fn->value.closure.native != NULL) {
+          /* compiled to c ahead of time, so called like a builtin */
+          SPILL();
+          value = runtime_apply(fn, argc, sp - argc);
+          REBASE();
+          UNSPILL();
+          sp -= argc + 1;
+          if (tail) {
+            goto ret;
+          }
+          *sp++ = value;
+          NEXT();
+        }
+        {
+          struct exp *lambda = fn->value.closure.lambda;
+          struct exp *callee = lambda->value.node.c;
+          struct exp **args = sp - argc;
+          if (tail) {
+            /* the caller's frame is dead, so the arguments move */
+            /* down to take its place */
+            memmove(base + 1, args, argc * sizeof *args);
+            args = base + 1;
+          } else {
+            if (vm.fp == vm.frames_end) {
+              grow_frames();
+            }
+            vm.fp->code = code;
+            vm.fp->pc = pc;
+            vm.fp->locals = locals;
+            vm.fp->captured = captured;
+            vm.fp->base = base;
+            vm.fp->escape = mark;
+            vm.fp += 1;
+            mark = NULL;
+            base = args - 1;
+          }
+          sp = args + lambda->value.node.slot;
+          ENSURE_ROOM(callee);
+          args = sp - lambda->value.node.slot;
+          vm.sp = sp;
+          env_bind(lambda, argc, args);
+          LOAD(callee);
+          locals = args;
+          captured = fn->value.closure.env;
+          if (gc_wanted) {
+            SPILL();
+            GC_SAFEPOINT();
+            UNSPILL();
+          }
+          if (config.jit) {
+            code->value.proto->calls += 1;
+            if (code->value.proto->calls == JIT_THRESHOLD) {
+              jit_compile(code->value.proto);
+            }
+            NATIVE();
+          }
+        }
+        NEXT();
+      case CONTINUATION:
+        vm.sp = sp;
+        if (argc == 1 && target(fn) == &run) {
+          k = fn;
+          value = sp[-1];
+          goto resume;
+        }
+        return cont_throw(fn, argc, sp - argc);
+      default:
+        vm.sp = sp;
+        return err_error("eval: bad function type",
+                         exp_list_from(argc + 1, sp - argc - 1));
+      }
+
+      /* call/cc and call/ec call their argument with a continuation */
+      /* of their own call, in place of themselves and the argument */
+    control:
+      vm.sp = sp;
+      builtin_check_arity(fn, argc, sp - argc);
+      if (fn->value.function.fn == &cont_call_cc) {
+        if (tail) {
+          k = copy(&run, NULL, base);
+        } else {
+          struct frame top;
+          top.code = code;
+          top.pc = pc;
+          top.locals = locals;
+          top.captured = captured;
+          top.base = base;
+          top.escape = NULL;
+          k = copy(&run, &top, sp - 2);
+        }
+      } else {
+        /* an escape marks the frame pushed for the call, which a */
+        /* call in tail position returns from straight away */
+        struct cont *c;
+        k = cont_new(CONT_MARK);
+        c = k->value.cont;
+        c->run = run.id;
+        c->level = run.level;
+        c->frame = vm.fp - vm.frames + 1;
+        c->base = sp - 2 - vm.stack;
+        if (tail) {
+          pc = code->value.proto->code + code->value.proto->length - 1;
+          tail = 0;
+        }
+        if (IS(sp[-1], CLOSURE) && sp[-1]->value.closure.native == NULL) {
+          mark = k;
+        }
+      }
+      sp[-2] = sp[-1];
+      sp[-1] = k;
+      goto call;
+
+      /* back to where continuation k was made, with value */
+    resume:
+      {
+        struct cont *c = k->value.cont;
+        if (c->type == CONT_MARK) {
+          vm.fp = vm.frames + c->frame;
+        } else {
+          size_t i;
+          for (i = 0; i < c->nframes; i += 1) {
+            load_frame(&vm.frames[c->frame + i], &c->frames[i]);
+          }
+          vm.fp = vm.frames + c->frame + c->nframes;
+          memcpy(vm.stack + c->slot, c->slots, c->nslots * sizeof *c->slots);
+        }
+        base = vm.stack + c->base;
+      }
+      goto ret;
+
+    ret:
+      if (vm.fp == vm.frames + entry) {
+        vm.sp = base;
+        vm.active = run.outer;
+        return value;
+      }
+      sp = base;
+      vm.fp -= 1;
+      code = vm.fp->code;
+      pc = vm.fp->pc;
+      locals = vm.fp->locals;
+      captured = vm.fp->captured;
+      base = vm.fp->base;
+      consts = code->value.proto->consts;
+      *sp++ = value;
+      NATIVE();
+      NEXT();
+#if !THREADED
+    default:
+      return err_error("vm: bad opcode", NULL);
+    }
+#endif
+  }
+#undef CASE
+#undef NEXT
+}
+
+#undef VARIABLE
+#undef LOAD
+#undef NATIVE
+#undef ENSURE_ROOM
+#undef REBASE
+#undef MOVED
+#undef SPILL
+#undef UNSPILL
+#undef ASSIGN
+
+#define VM_NAME(op) #op,
+static const char *names[] = { VM_OPCODES(VM_NAME) };
+#undef VM_NAME
+
+void vm_disassemble(struct exp *code) {
+  struct proto *proto = code->value.proto;
+  size_t i;
+  for (i = 0; i < proto->length; i += 1) {
+    unsigned int w = proto->code[i];
+    printf("%4lu %-14s %u", (unsigned long)i, names[VM_OP(w)], VM_ARG(w));
+    if (VM_WIDTH(VM_OP(w)) == 2) {
+      i += 1;
+      printf(" %u", proto->code[i]);
+    }
+    printf("\n");
+  }
+}
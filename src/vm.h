@@ -0,0 +1,95 @@
+#ifndef VM_H
+#define VM_H
+/* an instruction is a single word: the opcode in the low byte */
+/* and its operand in the rest. PRIM and TAIL_PRIM are followed */
+/* by one extra word holding the constant index of the callee, */
+/* DEFINE_LOCAL by the constant index of the variable name, and */
+/* CLOSURE by the constant index of the lambda. the operand of */
+/* CLOSURE is how many free variables it takes off the stack. */
+/* variable operands are a slot in the frame (LOCAL) or in the */
+/* closure (FREE), with VM_BOXED set if the slot holds a box. */
+/* the opcodes from ADD on are open-coded builtins. their operand */
+/* is the constant index of the builtin's cell, which guards them. */
+/* every proto ends in a RETURN, whether or not it is reachable. */
+#define VM_OPCODES(X)                           \
+  X(CONST)                                      \
+  X(LOCAL)                                      \
+  X(FREE)                                       \
+  X(GLOBAL)                                     \
+  X(SET_LOCAL)                                  \
+  X(SET_FREE)                                   \
+  X(SET_GLOBAL)                                 \
+  X(DEFINE_LOCAL)                               \
+  X(DEFINE_GLOBAL)                              \
+  X(BOX)                                        \
+  X(POP)                                        \
+  X(JUMP)                                       \
+  X(JUMP_IF_FALSE)                              \
+  X(JUMP_IF_TRUE)                               \
+  X(CLOSURE)                                    \
+  X(CALL)                                       \
+  X(TAIL_CALL)                                  \
+  X(PRIM)                                       \
+  X(TAIL_PRIM)                                  \
+  X(RETURN)                                     \
+  X(ADD)                                        \
+  X(SUB)                                        \
+  X(NUM_EQ)                                     \
+  X(GT)                                         \
+  X(CONS)                                       \
+  X(CAR)                                        \
+  X(CDR)                                        \
+  X(EQ)                                         \
+  X(VECTOR_REF)                                 \
+  X(VECTOR_SET)
+
+#define VM_ENUM(op) OP_##op,
+enum opcode {
+  VM_OPCODES(VM_ENUM)
+  OP_COUNT
+};
+#undef VM_ENUM
+
+#define VM_INSTR(op, arg) ((unsigned int)(op) | ((unsigned int)(arg) << 8))
+#define VM_OP(instr) ((instr) & 0xff)
+#define VM_ARG(instr) ((instr) >> 8)
+#define VM_ARG_MAX 0xffffff
+#define VM_BOXED 0x10000
+#define VM_SLOT(arg) ((arg) & 0xffff)
+
+/* how many words an instruction takes up */
+#define VM_WIDTH(op)                                                    \
+  ((op) == OP_PRIM || (op) == OP_TAIL_PRIM ||                           \
+   (op) == OP_DEFINE_LOCAL || (op) == OP_CLOSURE ? 2 : 1)
+
+struct proto {
+  unsigned int *code;
+  size_t length;
+  size_t capacity;
+  struct exp **consts;
+  size_t nconsts;
+  size_t max_stack;
+  /* calls so far, and native code once there is any, see jit.h */
+  unsigned long calls;
+  struct jit_code *native;
+};
+
+/* where the vm was, to go back to after a longjmp past it */
+struct vm_state {
+  size_t sp;
+  size_t fp;
+  struct activation *active;
+};
+
+extern struct exp *vm_run(struct exp *proto);
+extern void vm_reset(void);
+extern void vm_save(struct vm_state *state);
+extern void vm_restore(struct vm_state *state);
+/* returns value to a continuation the vm made, see cont.h */
+extern struct exp *vm_throw(struct exp *k, struct exp *value);
+struct env;
+/* the stack, the frames, and what each activation is running */
+extern void vm_roots(void (*exp)(struct exp **),
+                     void (*env)(struct env **));
+extern void vm_disassemble(struct exp *proto);
+#endif
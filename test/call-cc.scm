@@ -0,0 +1,82 @@
+;; flags: --eval=vm
+;; call/cc makes first-class continuations on the virtual machine,
+;; which can be resumed after the call has returned, and call/ec
+;; makes escape-only ones
+
+(+ 1 (call/cc (lambda (k) (+ 10 (k 1)))))
+;; 2
+
+(+ 1 (call/ec (lambda (k) (+ 100 (k 5)))))
+;; 6
+
+(define (find-first pred list)
+  (call/ec
+   (lambda (return)
+     (for-each (lambda (x) (if (pred x) (return x) #f)) list)
+     #f)))
+(find-first (lambda (x) (> x 3)) '(1 2 3 4 5))
+;; 4
+
+(find-first (lambda (x) (> x 30)) '(1 2 3 4 5))
+;; #f
+
+;; resuming a continuation after its call returned, from a later form
+(define saved #f)
+(define count 0)
+(define (resumable)
+  ((lambda (v) (set! count (+ count 1)) v)
+   (call/cc (lambda (k) (set! saved k) 0))))
+(resumable)
+;; 0
+
+(if (< count 3) (saved count) 'done)
+;; 1
+
+count
+;; 2
+
+;; a generator bounces between its own continuation and the caller's
+(define (make-generator list)
+  (define return #f)
+  (define (resume)
+    (for-each
+     (lambda (x)
+       (call/cc
+        (lambda (next)
+          (set! resume (lambda () (next #f)))
+          (return x))))
+     list)
+    (return 'end))
+  (lambda ()
+    (call/cc
+     (lambda (r)
+       (set! return r)
+       (resume)))))
+(define next (make-generator '(a b c)))
+(next)
+;; a
+
+(next)
+;; b
+
+(next)
+;; c
+
+(next)
+;; end
+
+;; escapes in a loop do not pile up
+(define (escapes n acc)
+  (if (= n 0)
+      acc
+      (escapes (- n 1) (call/ec (lambda (k) (k (+ acc 1)))))))
+(escapes 100000 0)
+;; 100000
+
+;; an escape continuation is no good once its call has returned
+(define escaped #f)
+(call/ec (lambda (k) (set! escaped k) 1))
+;; 1
+
+(escaped 2)
+;; error: continuation: escape from a call that returned
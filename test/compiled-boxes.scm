@@ -0,0 +1,29 @@
+;; flags: --gc=ms --gc-step=50 --heap-initial=16k
+;; compiled too
+;; an assigned variable lives in a box, and marking in steps must
+;; see a list moved into one after the box was scanned. compiled
+;; code collects only between forms, so there are many of them
+
+(define (make-swap a b)
+  (lambda ()
+    (define t a)
+    (set! a b)
+    (set! b t)
+    (+ (length a) (length b))))
+
+(define swaps (map (lambda (i) (make-swap (range 10) (range i))) (range 40)))
+
+(define (churn) (for-each (lambda (swap) (list (swap))) swaps))
+(define (junk) (for-each range (range 25)))
+
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+(junk) (junk) (churn) (churn) (churn) (churn) (churn)
+
+(reduce + (map (lambda (swap) (swap)) swaps) 0)
+;; 1180
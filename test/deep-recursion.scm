@@ -0,0 +1,24 @@
+;; both evaluators keep their stacks on the heap, so recursion that
+;; is not in tail position goes as deep as memory allows
+
+(define (count-up n)
+  (if (= n 0)
+      0
+      (+ 1 (count-up (- n 1)))))
+(count-up 1000000)
+;; 1000000
+
+;; range, map and length in the stdlib recurse once per element
+(length (map (lambda (x) (* x 2)) (range 300000)))
+;; 300000
+
+;; an error deep down unwinds the stacks, and they shrink back
+(define (fail-at n)
+  (if (= n 0)
+      (car '())
+      (+ 1 (fail-at (- n 1)))))
+(fail-at 100000)
+;; error: car requires a pair argument, got: ()
+
+(count-up 10)
+;; 10
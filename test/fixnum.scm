@@ -0,0 +1,20 @@
+;; fixnums are a bit short of a machine word, and a literal that
+;; does not fit is an error rather than some other number
+
+4611686018427387903
+;; 4611686018427387903
+
+-4611686018427387904
+;; -4611686018427387904
+
+4611686018427387904
+;; error: read: number out of range
+
+-4611686018427387905
+;; error: read: number out of range
+
+99999999999999999999999
+;; error: read: number out of range
+
+(+ 1 2)
+;; 3
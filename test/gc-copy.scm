@@ -0,0 +1,38 @@
+;; flags: --gc=copy --heap-initial=64k
+;; the copying collector moves everything that survives, so what
+;; refers to a moved object must follow it
+
+(define shared (cons 'a 'b))
+(define holder (vector shared (list shared) "a string"))
+(define (counter)
+  (define n 0)
+  (lambda ()
+    (set! n (+ n 1))
+    n))
+(define tick (counter))
+(tick)
+;; 1
+
+(for-each (lambda (i) (range 100)) (range 2000))
+
+;; shared structure stays shared
+(eq? shared (vector-ref holder 0))
+;; #t
+
+(eq? shared (car (vector-ref holder 1)))
+;; #t
+
+(vector-ref holder 2)
+;; "a string"
+
+;; a closure keeps its variables
+(tick)
+;; 2
+
+;; a symbol made from a string is still the one that was read
+(eq? (string->symbol "shared") 'shared)
+;; #t
+
+;; the collection happens inside the form, while the list is built
+(reduce + (reduce cons (range 50000) '()) 0)
+;; 1249975000
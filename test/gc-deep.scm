@@ -0,0 +1,26 @@
+;; flags: --heap-initial=1m
+;; marking works from a stack of its own, so a structure is never
+;; too deep to collect
+
+(define (nest n)
+  (reduce (lambda (i acc) (cons acc '())) (range n) 'bottom))
+
+(define (depth x n)
+  (if (pair? x)
+      (depth (car x) (+ n 1))
+      n))
+
+;; nested through the car a million deep, which is where recursive
+;; marking would go
+(define deep (nest 1000000))
+(for-each (lambda (i) (range 1000)) (range 2000))
+
+(depth deep 0)
+;; 1000000
+
+;; what was swept is reused
+(define deep #f)
+(for-each (lambda (i) (range 1000)) (range 2000))
+
+(depth (nest 1000) 0)
+;; 1000
@@ -0,0 +1,43 @@
+;; flags: --gc=gen --heap-initial=64k
+;; old objects that are given new ones to hold must keep them alive
+;; through minor collections, which only look at what was written to
+
+(define (churn n)
+  (for-each (lambda (i) (range 100)) (range n)))
+
+(define global '())
+(define table (make-vector 3 '()))
+(define (make-box)
+  (define value '())
+  (lambda (new)
+    (define old value)
+    (set! value new)
+    old))
+(define box (make-box))
+
+;; by now these are all old
+(churn 1000)
+
+(set! global (range 5))
+(vector-set! table 1 (range 3))
+(box (range 4))
+;; ()
+(churn 1000)
+
+global
+;; (0 1 2 3 4)
+
+(vector-ref table 1)
+;; (0 1 2)
+
+(box '())
+;; (0 1 2 3)
+
+;; an old object written to again and again, with collections in
+;; between, holds on to the last thing written
+(for-each (lambda (n)
+            (vector-set! table 2 (range (- 300 n)))
+            (churn 10))
+          (range 300))
+(vector-ref table 2)
+;; (0)
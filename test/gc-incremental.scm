@@ -0,0 +1,26 @@
+;; flags: --gc=ms --gc-step=1 --heap-initial=64k --heap-max=2m
+;; marking a step at a time while lists move between a vector and a
+;; closure, each held in only one place at a time
+
+(define slots (list->vector (map range (range 10))))
+
+(define (make-box)
+  (define value '())
+  (lambda (new)
+    (define old value)
+    (set! value new)
+    old))
+(define box (make-box))
+
+(for-each (lambda (i)
+            (vector-set! slots (mod i 10) (box (vector-ref slots (mod i 10))))
+            (range 50))
+          (range 5000))
+
+(reduce + (map (lambda (i) (length (vector-ref slots i))) (range 10))
+        (length (box '())))
+;; 45
+
+;; a cycle that lets the heap outgrow its limit is finished at once
+(define kept (reduce cons (range 100000) '()))
+;; error: gc: heap limit exceeded
@@ -0,0 +1,8 @@
+;; flags: --eval=vm --gc=nop --gc-stats
+;; --gc-stats prints a summary at exit. nop never collects, so it
+;; keeps everything and takes no time doing so, and the evaluator is
+;; fixed because each allocates its own way
+
+(define kept (reduce cons (range 1000) '()))
+(length kept)
+;; 1000
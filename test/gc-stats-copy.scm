@@ -0,0 +1,17 @@
+;; flags: --gc=copy --heap-initial=64k
+;; the copying collector counts what it keeps as it copies it
+
+(define (stat name)
+  (cdr (car (filter (lambda (entry) (eq? (car entry) name)) (gc-stats)))))
+
+(define kept (reduce cons (range 1000) '()))
+(for-each range (range 2000))
+
+(> (stat 'collections) 0)
+;; #t
+
+(>= (stat 'live-objects) 1000)
+;; #t
+
+(>= (stat 'pauses) (stat 'collections))
+;; #t
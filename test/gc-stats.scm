@@ -0,0 +1,42 @@
+;; flags: --heap-initial=64k
+;; (gc-stats) reports what the collector has done as an association
+;; list of fixnums, with times in microseconds
+
+(define (stat name)
+  (define (find stats)
+    (cond
+     ((null? stats) 'missing)
+     ((eq? (car (car stats)) name) (cdr (car stats)))
+     (else (find (cdr stats)))))
+  (find (gc-stats)))
+
+(map car (gc-stats))
+;; (collections bytes-allocated objects-allocated live-bytes live-objects pauses pause-total pause-max)
+
+(filter (lambda (value) (not (number? value))) (map cdr (gc-stats)))
+;; ()
+
+(define before (stat 'objects-allocated))
+(define kept (reduce cons (range 1000) '()))
+
+(>= (- (stat 'objects-allocated) before) 1000)
+;; #t
+
+;; garbage enough to fill the heap many times over
+(for-each range (range 2000))
+
+(> (stat 'collections) 0)
+;; #t
+
+(>= (stat 'live-objects) 1000)
+;; #t
+
+(> (stat 'live-bytes) 0)
+;; #t
+
+(>= (stat 'pause-total) (stat 'pause-max))
+;; #t
+
+;; every collection takes at least one pause, and a step counts as one
+(>= (stat 'pauses) (stat 'collections))
+;; #t
@@ -0,0 +1,15 @@
+;; flags: --gc=ms --gc-threads=4 --heap-initial=64k
+;; marking shared among threads, with sweeping in the background,
+;; must find everything one thread would
+
+;; many short lists hanging off one vector give the threads work to
+;; steal from each other
+(define wide (list->vector (map (lambda (i) (range 50)) (range 2000))))
+(for-each (lambda (i) (range 500)) (range 2000))
+
+(reduce + (map (lambda (i) (reduce + (vector-ref wide i) 0)) (range 2000)) 0)
+;; 2450000
+
+;; the collection happens inside the form, while the list is built
+(reduce + (reduce cons (range 100000) '()) 0)
+;; 4999950000
@@ -0,0 +1,18 @@
+;; flags: --heap-initial=256k --heap-max=4m
+;; collections are triggered by allocation, and a program that holds
+;; on to more than --heap-max gets an error instead of more memory,
+;; with any collector but nop, which frees nothing
+
+;; garbage is collected as it is made, so this stays under the limit
+(length (map (lambda (i) (length (range 1000))) (range 500)))
+;; 500
+
+(define kept (reduce cons (range 200000) '()))
+;; error: gc: heap limit exceeded
+
+kept
+;; error: env: no binding for symbol: kept
+
+;; what was built is garbage again, so there is room for more
+(length (range 1000))
+;; 1000
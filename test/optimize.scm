@@ -0,0 +1,40 @@
+;; the optimizer folds builtins on constants, but only in code that
+;; runs before they could be redefined
+
+(define six (* 2 3))
+six
+;; 6
+
+(optimize '(if (pair? 1) 'yes 'no))
+;; 'no
+
+(optimize '((lambda (x) (* x 3)) 2))
+;; 6
+
+;; a call to anything else might redefine a builtin first
+(optimize '(if (pair? 1) (f) (g)))
+;; (if (pair? 1) (f) (g))
+
+(optimize '(lambda () (+ 1 2)))
+;; (lambda () (+ 1 2))
+
+;; nor is a call folded when it would fail
+(optimize '(car 1))
+;; (car 1)
+
+(optimize '(div 1 0))
+;; (div 1 0)
+
+(define (three) (+ 1 2))
+(define (use-car) (car '(1 2)))
+(define + -)
+(define (car pair) 'mine)
+
+(three)
+;; -1
+
+(use-car)
+;; mine
+
+(+ 1 2)
+;; -1
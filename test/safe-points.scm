@@ -0,0 +1,30 @@
+;; flags: --heap-initial=64k
+;; collections happen at calls in the middle of a form, so whatever
+;; the evaluators hold on their stacks must survive them
+
+(define (tree n)
+  (if (= n 0)
+      '()
+      (cons (tree (- n 1)) (tree (- n 1)))))
+
+(define (size t)
+  (if (null? t)
+      1
+      (+ (size (car t)) (size (cdr t)))))
+
+;; the left half waits on the stack while the right is built
+(size (tree 15))
+;; 32768
+
+;; so do a closure's variables, and arguments already evaluated
+(define (adder n)
+  (lambda (x) (+ x n)))
+(reduce (lambda (i acc) (+ acc ((adder 1) (size (tree 5))))) (range 2000) 0)
+;; 66000
+
+;; and what eval and apply are in the middle of
+(eval '(size (tree 12)))
+;; 4096
+
+(apply + (map size (list (tree 10) (tree 11))))
+;; 3072